@@ -4,7 +4,57 @@
 #include <cctype>    //For std::isspace
 #include <fstream>   //Needed by read_sailings to work with files
 #include <stdexcept> //Needed by read_sailings to handle exceptions
-#include <iomanip>   //Needed by print_sailing to format output
+#include <string_view>  //Fields are parsed as views into the input line
+#include <array>        //Fixed-size field table used by the parser
+#include <charconv>     //For std::from_chars
+#include <climits>      //For INT_MAX when range-checking parsed integers
+#include <algorithm>    //For std::count when sizing the record vector
+#include <cstdint>      //Fixed-width keys for packed dates
+#include <unordered_map> //Hashed per-day aggregation
+#include <unordered_set> //Sailings already read, for multi-file input
+#include <exception>    //Carries loader errors out of worker threads
+#include <thread>       //Parallel aggregation
+#include <deque>        //Stable storage for interned names
+#include <utility>      //For std::move and std::pair
+#include <sstream>      //Captures the load report for snapshots
+#include <filesystem>   //Source file size and modification time
+#include <cstring>      //For std::memcpy/std::memcmp on snapshot data
+#include <chrono>       //Polling interval for tail mode, benchmark timings
+#include <random>       //Synthetic data generator
+#include <numeric>      //For std::accumulate
+#include <cstdlib>      //For std::strtod
+#include <iomanip>      //Column layout of the benchmark table
+#include <cmath>        //For std::ceil in delay quantiles
+#include <memory>       //Owns the spill directory of an external group-by
+
+#if defined(__AVX2__)
+#include <immintrin.h>  //AVX2 field splitter
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>  //SSE2 field splitter
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>     //_BitScanForward
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>      //open()
+#include <sys/mman.h>   //mmap()/munmap()
+#include <sys/stat.h>   //fstat()
+#include <unistd.h>     //close()
+#include <sys/socket.h> //Unix domain sockets for serve and query
+#include <sys/un.h>     //sockaddr_un
+#include <poll.h>       //poll() over the server's clients
+#include <cerrno>       //EINTR
+#include <csignal>      //Ignore SIGPIPE from departed clients, stop serve on SIGINT/SIGTERM
+#include <sys/uio.h>    //iovec for the asynchronous reader
+#endif
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h> //io_uring requests for --loader=async
+#include <sys/syscall.h>    //io_uring has no libc wrappers
+#define SAILING_IO_URING
+#endif
+#endif
 
 /* A structure type to represent a year/month/day combination */
 struct Date
@@ -36,6 +86,61 @@ struct Sailing
     int actual_duration{ 0 };
 };
 
+/* The fields of one successfully parsed line. The text fields are views into
+   the parsed line, so a SailingView is only valid while that text is. */
+struct SailingView
+{
+    int route_number{ 0 };
+    std::string_view source_terminal{};
+    std::string_view dest_terminal{};
+    std::string_view vessel_name{};
+
+    Date departure_date{};
+    TimeOfDay scheduled_departure_time{};
+
+    int expected_duration{ 0 };
+    int actual_duration{ 0 };
+};
+
+/* A dictionary of interned names. Each distinct name is stored once and is
+   referred to by its position in names. ids maps a name to that position;
+   its keys view the strings in names, which is a deque so that they never
+   move. For the same reason a dictionary can be moved but not copied. */
+struct NameDictionary
+{
+    NameDictionary() = default;
+    NameDictionary(NameDictionary&&) = default;
+    NameDictionary& operator=(NameDictionary&&) = default;
+    NameDictionary(NameDictionary const&) = delete;
+    NameDictionary& operator=(NameDictionary const&) = delete;
+
+    std::deque<std::string> names{};
+    std::unordered_map<std::string_view, std::uint32_t> ids{};
+};
+
+/* Column-oriented storage for a set of sailings. Entry i of every column
+   belongs to the i-th sailing; terminal and vessel names are stored as ids
+   into the two dictionaries. Analyses only touch the columns they need. */
+struct SailingTable
+{
+    NameDictionary terminals{};
+    NameDictionary vessels{};
+
+    std::vector<int> route_number{};
+    std::vector<std::uint32_t> source_terminal{};
+    std::vector<std::uint32_t> dest_terminal{};
+    std::vector<std::uint32_t> vessel{};
+
+    std::vector<int> year{};
+    std::vector<int> month{};
+    std::vector<int> day{};
+    std::vector<std::uint8_t> hour{};
+    std::vector<std::uint8_t> minute{};
+
+    std::vector<int> expected_duration{};
+    std::vector<int> actual_duration{};
+};
+
 /* A structure type to store aggregated performance data for a single
    route. */
 struct RouteStatistics
@@ -55,13 +160,140 @@ struct DayStatistics
 };
 
 
-/* Helper Struct for including ratio in Day Statistc*/
-struct ratio_DayStat
+/* Invalid lines of one load, by kind of error (indexed by ParseErrorKind)
+   and, within each kind, by field: the index of the offending field, or for
+   an incomplete line the number of fields found (counts at or above
+   error_field_slots - 1 share the last slot). samples holds the first line
+   numbers of each kind, up to the limit the load was given. */
+const size_t parse_error_kinds{ 6 };
+const size_t error_field_slots{ 24 };
+
+struct ErrorTally
 {
-    Date date{};
-    int total_sailings{ 0 };
-    int late_sailings{ 0 };
-    double ratio{ 0 };
+    std::array<std::int64_t, parse_error_kinds> lines{};
+    std::array<std::array<std::int64_t, error_field_slots>, parse_error_kinds> fields{};
+    std::array<std::vector<int>, parse_error_kinds> samples{};
+};
+
+/* Line counts from one load: lines read, and how many held a valid sailing. */
+struct LoadCounts
+{
+    int valid_sailings{ 0 };
+    int total_lines{ 0 };
+    ErrorTally errors{};
+};
+
+/* Per-route totals for a set of sailings. routes holds one entry per distinct
+   route in first-seen order. Small non-negative route numbers are found
+   through dense_index (route number -> position in routes + 1, or 0 if
+   unseen); any others go through sparse_index. */
+const int dense_route_limit{ 1 << 16 };
+
+struct RouteAggregate
+{
+    std::vector<RouteStatistics> routes{};
+    std::vector<size_t> dense_index{};
+    std::unordered_map<int, size_t> sparse_index{};
+};
+
+/* Hash and equality functors so that Date can key an unordered_map. */
+std::uint64_t pack_date(const Date& date);
+bool cmp_date(const Date& date1, const Date& date2);
+
+struct DateHash
+{
+    size_t operator()(const Date& date) const { return std::hash<std::uint64_t>{}(pack_date(date)); }
+};
+
+struct DateEqual
+{
+    bool operator()(const Date& date1, const Date& date2) const { return cmp_date(date1, date2); }
+};
+
+/* Packed calendar keys
+   A DayNumber is the number of days since 1970-01-01 in the proleptic
+   Gregorian calendar, so consecutive days have consecutive numbers and
+   dates compare, hash and sort as one integer. A MinuteOfDay is the number
+   of minutes since midnight of a valid TimeOfDay. The parser accepts any
+   integers for the date fields, so only dates for which has_day_number is
+   true have a DayNumber; code keyed on day numbers keeps a fallback for
+   the rest. The keys are computed where an index, sort or group needs
+   them: Date, TimeOfDay and the SailingTable columns still store each
+   field as an int, so stored sailings are no smaller for them. */
+using DayNumber = std::int32_t;
+using MinuteOfDay = std::uint16_t;
+
+const int day_number_year_limit{ 1000000 };
+
+constexpr bool is_leap_year(int year)
+{
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+constexpr int days_in_month(int year, int month)
+{
+    return month == 2 ? (is_leap_year(year) ? 29 : 28) : (month == 4 || month == 6 || month == 9 || month == 11 ? 30 : 31);
+}
+
+/* True if date is a real calendar date within day_number_year_limit years
+   of year 0. */
+constexpr bool has_day_number(const Date& date)
+{
+    return date.year > -day_number_year_limit && date.year < day_number_year_limit && date.month >= 1 && date.month <= 12
+        && date.day >= 1 && date.day <= days_in_month(date.year, date.month);
+}
+
+/* Howard Hinnant's days_from_civil. date must satisfy has_day_number. */
+constexpr DayNumber to_day_number(const Date& date)
+{
+    const int year{ date.year - (date.month <= 2 ? 1 : 0) };
+    const int era{ (year >= 0 ? year : year - 399) / 400 };
+    const int year_of_era{ year - era * 400 };
+    const int day_of_year{ (153 * (date.month + (date.month > 2 ? -3 : 9)) + 2) / 5 + date.day - 1 };
+    const int day_of_era{ year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year };
+    return era * 146097 + day_of_era - 719468;
+}
+
+/* The inverse of to_day_number (civil_from_days). */
+constexpr Date from_day_number(DayNumber day_number)
+{
+    const int days{ day_number + 719468 };
+    const int era{ (days >= 0 ? days : days - 146096) / 146097 };
+    const int day_of_era{ days - era * 146097 };
+    const int year_of_era{ (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365 };
+    const int day_of_year{ day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100) };
+    const int month_index{ (5 * day_of_year + 2) / 153 };
+    const int month{ month_index < 10 ? month_index + 3 : month_index - 9 };
+    return Date{ day_of_year - (153 * month_index + 2) / 5 + 1, month, year_of_era + era * 400 + (month <= 2 ? 1 : 0) };
+}
+
+/* time must be a valid 24-hour time. */
+constexpr MinuteOfDay to_minute_of_day(const TimeOfDay& time)
+{
+    return static_cast<MinuteOfDay>(time.hour * 60 + time.minute);
+}
+
+constexpr TimeOfDay from_minute_of_day(MinuteOfDay minute)
+{
+    return TimeOfDay{ minute / 60, minute % 60 };
+}
+
+static_assert(to_day_number(Date{ 1, 1, 1970 }) == 0, "day numbers count from 1970-01-01");
+static_assert(to_day_number(Date{ 1, 3, 2000 }) - to_day_number(Date{ 28, 2, 2000 }) == 2, "2000 is a leap year");
+static_assert(from_day_number(to_day_number(Date{ 31, 12, 2022 })).day == 31, "from_day_number inverts to_day_number");
+static_assert(to_minute_of_day(from_minute_of_day(1439)) == 1439, "from_minute_of_day inverts to_minute_of_day");
+
+/* Per-day totals for a set of sailings. days holds one entry per distinct
+   date in first-seen order. Dates with a day number in [0, dense_day_limit)
+   (1970 to 2149) are found through dense_index (day number -> position in
+   days + 1, or 0 if unseen); any others go through sparse_index. */
+const DayNumber dense_day_limit{ 1 << 16 };
+
+struct DayAggregate
+{
+    std::vector<DayStatistics> days{};
+    std::vector<size_t> dense_index{};
+    std::unordered_map<Date, size_t, DateHash, DateEqual> sparse_index{};
 };
 
 
@@ -98,21 +330,333 @@ struct InvalidTimeException
     TimeOfDay bad_time{};
 };
 
+/* The result of splitting one line into fields: the first
+   sailing_field_count fields (as views into the line), the total number of
+   fields, and a mask with bit i set when field i is empty or contains only
+   whitespace. field_start is scratch space for the splitter. */
+const unsigned int sailing_field_count{ 11 };
+
+struct FieldSplit
+{
+    std::array<std::string_view, sailing_field_count> fields{};
+    unsigned int count{ 0 };
+    std::uint32_t blank_fields{ 0 };
+    size_t field_start{ 0 };
+};
+
+/* Non-throwing form of the error cases above, returned by try_parse_sailing.
+   kind says which case occurred (None on success), and only the member that
+   matches kind is meaningful. bad_field is a view into the parsed line and
+   is also set for OutOfRange, a numeric field whose value does not fit in
+   an int (which std::stoi reports as std::out_of_range). which_field is set
+   for every kind but IncompleteLine: for InvalidTime it is the hour field,
+   or the minute field if the hour is valid. */
+enum class ParseErrorKind
+{
+    None,
+    IncompleteLine,
+    EmptyField,
+    NonNumericData,
+    InvalidTime,
+    OutOfRange
+};
+
+struct ParseError
+{
+    ParseErrorKind kind{ ParseErrorKind::None };
+    unsigned int num_fields{ 0 };
+    unsigned int which_field{ 0 };
+    std::string_view bad_field{};
+    TimeOfDay bad_time{};
+};
+
+/* An invalid line kept to be reported later: its line number and error,
+   with the bad field copied out of the line (error.bad_field is empty). */
+struct InvalidLine
+{
+    int line_number{ 0 };
+    ParseError error{};
+    std::string bad_field{};
+};
+
+/* Where a load reports invalid lines. By default each one is written to
+   stream as it is found, as read_sailings does. With summarize set they are
+   only counted in LoadCounts::errors, keeping the first samples line numbers
+   of each kind, and one summary follows the load totals. A number out of
+   range for an int ends a load that writes messages, unless
+   keep_out_of_range is set; then it gets a message like the other kinds.
+   If kept_lines is set, the messages are not written but the invalid
+   lines are appended to it, for a caller that reports them later. */
+struct LoadReport
+{
+    std::ostream& stream;
+    bool summarize{ false };
+    size_t samples{ 5 };
+    bool keep_out_of_range{ false };
+    std::vector<InvalidLine>* kept_lines{ nullptr };
+};
+
+/* The ways of reading an input file selected by --loader. */
+enum class LoaderKind
+{
+    Stream,
+    Mapped,
+    Parallel,
+    Async
+};
+
+/* The output formats selected by --format. */
+enum class ReportFormat
+{
+    Text,
+    Csv,
+    JsonLines
+};
+
+/* The keys a group_by query can group sailings on. */
+enum class GroupDimension
+{
+    Route,
+    SourceTerminal,
+    DestTerminal,
+    Vessel,
+    Year,
+    Month,
+    Hour,
+    Weekday,
+    Date,
+    Time
+};
+
+/* One row of a group_by result: the value of each grouped dimension, in the
+   order they were requested, and the totals for the matching sailings. The
+   delay of a sailing is actual_duration - expected_duration. */
+struct GroupStatistics
+{
+    std::vector<std::string> labels{};
+    int total_sailings{ 0 };
+    int late_sailings{ 0 };
+    double mean_delay{ 0 };
+    int max_delay{ 0 };
+};
+
+/* The subset of sailings a report is restricted to by --route, --from, --to
+   and --min-delay. The date bounds are inclusive; min_delay is the smallest
+   actual minus expected duration kept. */
+struct SailingFilter
+{
+    bool has_route{ false };
+    int route{ 0 };
+    bool has_first_date{ false };
+    Date first_date{};
+    bool has_last_date{ false };
+    Date last_date{};
+    bool has_min_delay{ false };
+    int min_delay{ 0 };
+};
+
+/* The kinds of invalid line generate can write, one for each error the
+   parser reports. */
+const char* const malformed_line_names[]{ "short", "long", "empty", "nonnumeric", "time" };
+const int malformed_line_kinds{ 5 };
+
+/* Settings for generate, from --rows, --routes, --vessels, --seed and
+   --malformed. */
+struct GeneratorSettings
+{
+    long long rows{ 1000000 };
+    std::vector<int> routes{};
+    int vessels{ 4 };
+    std::uint64_t seed{ 1 };
+    double malformed[malformed_line_kinds]{};
+};
+
+/* Command-line settings for the driver. */
+struct DriverOptions
+{
+    std::string action{};
+    std::string input_filename{};
+    LoaderKind loader{ LoaderKind::Stream };
+    std::string storage{ "rows" };
+    bool snapshot{ false };
+    std::string checkpoint{};
+    int follow_seconds{ 0 };
+    std::vector<GroupDimension> group_by{ GroupDimension::Route };
+    SailingFilter filter{};
+    int top_count{ 10 };
+    int min_sailings{ 1 };
+    ReportFormat format{ ReportFormat::Text };
+    GeneratorSettings generator{};
+    int repeat{ 3 };
+    std::string output{};
+    bool error_summary{ false };
+    int error_samples{ 5 };
+    std::string socket_path{};
+    std::string request{};
+    int memory_mb{ 256 };
+    std::string spill_directory{};
+    int shard_index{ 0 };
+    int shard_count{ 0 };
+};
+
 /* Function prototypes */
 /* Put your implementations of these functions in a2_functions.cpp */
 
 
 /*helpers for parse_sailing*/
-bool check_space_errors(const std::string& el);
 
-int convert_to_int_and_check(const std::string& str);
+template <bool StopAtNewline>
+size_t split_sailing_fields(std::string_view text, FieldSplit& split) noexcept;
+
+unsigned int lowest_bit(std::uint32_t mask) noexcept;
+
+ParseError parse_split_fields(const FieldSplit& split, SailingView& result) noexcept;
+
+ParseErrorKind parse_int_field(std::string_view str, int& value) noexcept;
+
+bool is_valid_time(const int hour, const int minute) noexcept;
+
+ParseError try_parse_sailing(std::string_view input_line, SailingView& result) noexcept;
+
+void throw_parse_error(const ParseError& error);
+
+Sailing parse_sailing_view(std::string_view input_line);
+
+SailingView parse_sailing_fields(std::string_view input_line);
+
+/*helpers for performance_by_route*/
+bool is_late_sailing(int expected_duration, int actual_duration);
+
+size_t worker_count(size_t items, size_t min_items_per_worker = 1 << 16);
+
+template <typename Task>
+void run_workers(size_t workers, Task task);
+
+RouteStatistics& route_entry(RouteAggregate& aggregate, int route_number);
+
+void add_route_sailing(RouteAggregate& aggregate, int route_number, bool late);
+
+void aggregate_routes(std::vector<Sailing> const& sailings, size_t begin, size_t end, RouteAggregate& aggregate);
+
+void aggregate_routes(SailingTable const& table, size_t begin, size_t end, RouteAggregate& aggregate);
 
-void time_check(const int hour, const int minute);
+template <typename SliceAggregator>
+RouteAggregate aggregate_routes_in_parallel(size_t count, SliceAggregator aggregate_slice);
+
+void merge_route_aggregate(RouteAggregate& into, RouteAggregate const& from);
 
 /*helpers for best_days & worst_days*/
-bool cmp_date(const Date& date1, const Date& date2);
 
-void update_ratio_struct(ratio_DayStat& stat, const Sailing& sailing);
+DayStatistics& day_entry(DayAggregate& aggregate, const Date& date);
+
+void add_day_sailing(DayAggregate& aggregate, const Date& date, bool late);
+
+void merge_day_aggregate(DayAggregate& into, DayAggregate const& from);
+
+std::vector<size_t> chronological_order(std::vector<DayStatistics> const& days);
+
+std::vector<DayStatistics> days_by_date(DayAggregate const& aggregate);
+
+DayAggregate aggregate_days(std::vector<Sailing> const& sailings);
+
+DayAggregate aggregate_days(SailingTable const& table);
+
+int compare_day_ratio(const DayStatistics& day1, const DayStatistics& day2);
+
+int compare_day_ratio_descending(const DayStatistics& day1, const DayStatistics& day2);
+
+template <typename Ranking>
+std::vector<DayStatistics> select_days(DayAggregate const& aggregate, Ranking ranking);
+
+std::vector<DayStatistics> best_days(DayAggregate const& aggregate);
+
+std::vector<DayStatistics> worst_days(DayAggregate const& aggregate);
+
+/*helpers for the top-K rankings*/
+template <typename Statistics>
+int compare_late_ratio(const Statistics& stats1, const Statistics& stats2);
+
+template <typename Statistics, typename Ranking>
+std::vector<Statistics> select_top(std::vector<Statistics> const& candidates, size_t count, int min_sailings, Ranking ranking);
+
+std::vector<DayStatistics> best_days(DayAggregate const& aggregate, size_t count, int min_sailings);
+
+std::vector<DayStatistics> worst_days(DayAggregate const& aggregate, size_t count, int min_sailings);
+
+std::vector<RouteStatistics> best_routes(std::vector<RouteStatistics> const& routes, size_t count, int min_sailings);
+
+std::vector<RouteStatistics> worst_routes(std::vector<RouteStatistics> const& routes, size_t count, int min_sailings);
+
+Sailing to_sailing(const SailingView& view);
+
+/*helpers for read_sailings, read_sailings_mapped & read_sailing_table*/
+template <typename Sink>
+void stream_sailing_lines(std::string const& input_filename, Sink& sink, LoadReport const& report);
+
+template <typename Sink>
+void map_sailing_lines(std::string const& input_filename, Sink& sink, LoadReport const& report);
+
+template <typename Sink>
+bool load_sailing_line(std::string_view line, int line_number, Sink& sink, LoadReport const& report, ErrorTally& errors);
+
+template <typename Sink>
+void map_sailing_lines_parallel(std::string const& input_filename, Sink& sink, LoadReport const& report);
+
+template <typename Sink>
+LoadCounts load_sailing_text(std::string_view text, int first_line_number, Sink& sink, LoadReport const& report);
+
+template <typename Sink>
+LoadCounts read_sailing_chunks(std::istream& input, Sink& sink, LoadReport const& report);
+
+template <typename Sink>
+void read_sailing_blocks(std::string const& input_filename, Sink& sink, LoadReport const& report);
+
+template <typename Sink>
+void stream_sailings_into(std::string const& input_filename, Sink& sink, LoadReport const& report);
+
+void report_invalid_line(const ParseError& error, int line_number, std::ostream& report);
+
+void note_invalid_line(const ParseError& error, int line_number, LoadReport const& report, ErrorTally& errors);
+
+void add_load_counts(LoadCounts& into, LoadCounts const& from, size_t samples);
+
+void print_load_summary(int valid_sailings, int total_lines, std::ostream& report);
+
+void print_load_summary(LoadCounts const& counts, LoadReport const& report);
+
+void print_error_summary(ErrorTally const& errors, std::ostream& report);
+
+void append_sailings(std::vector<Sailing>& sailings, std::vector<Sailing>&& more);
+
+void append_sailings(SailingTable& table, SailingTable&& more);
+
+void append_sailing(std::vector<Sailing>& sailings, const SailingView& view);
+
+void reserve_sailings(std::vector<Sailing>& sailings, size_t count);
+
+std::uint32_t intern_name(NameDictionary& dictionary, std::string_view name);
+
+void append_sailing(SailingTable& table, const SailingView& view);
+
+void reserve_sailings(SailingTable& table, size_t count);
+
+template <typename Sailings>
+bool run_action(DriverOptions const& options, Sailings const& sailings, std::ostream& output);
+
+std::ostream& diagnostic_stream(DriverOptions const& options);
+
+LoadReport load_report(DriverOptions const& options);
+
+bool is_driver_action(std::string const& action);
+
+bool parse_driver_option(std::string const& option, DriverOptions& options);
+
+/*helpers for the column storage mode*/
+size_t table_size(const SailingTable& table);
+
+SailingTable make_sailing_table(std::vector<Sailing> const& sailings);
+
+Sailing sailing_at(const SailingTable& table, size_t i);
 
 /* Functions to implement */
 
@@ -165,117 +709,305 @@ void update_ratio_struct(ratio_DayStat& stat, const Sailing& sailing);
 */
 Sailing parse_sailing(std::string const& input_line)
 {
-    /* Your Code Here */
-    std::string temp{};
-    std::vector<std::string> elements{};
+    return parse_sailing_view(input_line);
+}
+
+/* parse_sailing_view(input_line)
+   Same as parse_sailing, but input_line may be any slice of text (such as a
+   line of a memory-mapped file); see parse_sailing_fields.
+*/
+Sailing parse_sailing_view(std::string_view input_line)
+{
+    return to_sailing(parse_sailing_fields(input_line));
+}
+
+/* Copy a parsed line into a self-contained Sailing. */
+Sailing to_sailing(const SailingView& view)
+{
     Sailing S{};
 
-    for (size_t i = 0; i < input_line.size(); i++) {
-        if (input_line.at(i) != ',')
-            temp += input_line.at(i);
-        else {
-            elements.push_back(temp);
-            /*std::cout << temp;*/
-            temp.clear();
+    S.route_number = view.route_number;
+    S.source_terminal = std::string{ view.source_terminal };
+    S.dest_terminal = std::string{ view.dest_terminal };
+    S.vessel_name = std::string{ view.vessel_name };
+    S.departure_date = view.departure_date;
+    S.scheduled_departure_time = view.scheduled_departure_time;
+    S.expected_duration = view.expected_duration;
+    S.actual_duration = view.actual_duration;
 
-        }
+    return S;
+}
+
+/* parse_sailing_fields(input_line)
+   Throwing wrapper over try_parse_sailing: returns the parsed fields, or
+   throws the exception described for parse_sailing above. The text fields
+   of the result are views into input_line. */
+SailingView parse_sailing_fields(std::string_view input_line)
+{
+    SailingView S{};
+    const ParseError error{ try_parse_sailing(input_line, S) };
+    if (error.kind != ParseErrorKind::None)
+        throw_parse_error(error);
+    return S;
+}
 
+/* try_parse_sailing(input_line, result)
+   Non-throwing core of parse_sailing. The line is split into
+   std::string_view fields that point straight into input_line, and the
+   checks are made in the order documented for parse_sailing. On success
+   result holds the parsed fields (text fields still view input_line) and
+   the returned error has kind None; otherwise the returned error describes
+   the first problem found, with the same payload the matching exception
+   would carry, and result is unspecified. Nothing is allocated and nothing
+   is thrown, so rejecting a line costs no more than accepting one. */
+ParseError try_parse_sailing(std::string_view input_line, SailingView& result) noexcept
+{
+    FieldSplit split{};
+    split_sailing_fields<false>(input_line, split);
+    return parse_split_fields(split, result);
+}
+
+/* parse_split_fields(split, result)
+   The checks of try_parse_sailing, applied to a line that has already been
+   split by split_sailing_fields. */
+ParseError parse_split_fields(const FieldSplit& split, SailingView& result) noexcept
+{
+    const std::array<std::string_view, sailing_field_count>& elements{ split.fields };
+    ParseError error{};
+
+    if (split.count != sailing_field_count) {
+        error.kind = ParseErrorKind::IncompleteLine;
+        error.num_fields = split.count;
+        return error;
     }
-    elements.push_back(temp);
- 
-    if (elements.size() != 11) {
-        const IncompleteLineException e{ elements.size()};
 
-        throw e;
+    if (split.blank_fields != 0) {
+        error.kind = ParseErrorKind::EmptyField;
+        error.which_field = lowest_bit(split.blank_fields);
+        return error;
     }
 
-    for (size_t i{ 0 }; i < elements.size(); i++) {
-        if (check_space_errors(elements.at(i))) {
-            const EmptyFieldException e{ i };
-            throw e;
+    /* Numeric fields in line order, so the first bad one is reported. */
+    const std::array<std::pair<unsigned int, int*>, 8> numeric_fields{ {
+        { 0, &result.route_number },
+        { 3, &result.departure_date.year },
+        { 4, &result.departure_date.month },
+        { 5, &result.departure_date.day },
+        { 6, &result.scheduled_departure_time.hour },
+        { 7, &result.scheduled_departure_time.minute },
+        { 9, &result.expected_duration },
+        { 10, &result.actual_duration },
+    } };
+    for (const auto& field : numeric_fields) {
+        const ParseErrorKind kind{ parse_int_field(elements[field.first], *field.second) };
+        if (kind != ParseErrorKind::None) {
+            error.kind = kind;
+            error.which_field = field.first;
+            error.bad_field = elements[field.first];
+            return error;
         }
+    }
+    result.source_terminal = elements[1];
+    result.dest_terminal = elements[2];
+    result.vessel_name = elements[8];
 
+    if (!is_valid_time(result.scheduled_departure_time.hour, result.scheduled_departure_time.minute)) {
+        error.kind = ParseErrorKind::InvalidTime;
+        error.which_field = result.scheduled_departure_time.hour >= 0 && result.scheduled_departure_time.hour <= 23 ? 7 : 6;
+        error.bad_time = result.scheduled_departure_time;
+        return error;
     }
-    for (size_t i{ 0 }; i < elements.size(); i++) {
-        switch (i) {
-        case 0:
-            S.route_number = convert_to_int_and_check(elements.at(i)); 
-            break;
-        case 1:
-            S.source_terminal = elements.at(i);
-            break;
-        case 2:
-            S.dest_terminal = elements.at(i);
-            break;
-        case 3:
-            S.departure_date.year = convert_to_int_and_check(elements.at(i));
-            break;
-        case 4:
-            S.departure_date.month = convert_to_int_and_check(elements.at(i));
-            break;
-        case 5:
-            S.departure_date.day = convert_to_int_and_check(elements.at(i));
-            break;
-        case 6:
-            S.scheduled_departure_time.hour = convert_to_int_and_check(elements.at(i));
-            break;
-        case 7:
-            S.scheduled_departure_time.minute = convert_to_int_and_check(elements.at(i));
-            break;
-        case 8:
-            S.vessel_name = elements.at(i);
-            break;
-        case 9:
-            S.expected_duration = convert_to_int_and_check(elements.at(i));
-            break;
-        case 10:
-            S.actual_duration = convert_to_int_and_check(elements.at(i));
-            break;
-            
-        }
 
+    return error;
+
+}
+
+/* Throw the exception that parse_sailing documents for error. A number too
+   large for an int is reported as std::out_of_range, as std::stoi does. */
+void throw_parse_error(const ParseError& error) {
+    switch (error.kind) {
+    case ParseErrorKind::None:
+        break;
+    case ParseErrorKind::IncompleteLine:
+        throw IncompleteLineException{ error.num_fields };
+    case ParseErrorKind::EmptyField:
+        throw EmptyFieldException{ error.which_field };
+    case ParseErrorKind::NonNumericData:
+        throw NonNumericDataException{ std::string{ error.bad_field } };
+    case ParseErrorKind::InvalidTime:
+        throw InvalidTimeException{ error.bad_time };
+    case ParseErrorKind::OutOfRange:
+        throw std::out_of_range("\"" + std::string{ error.bad_field } + "\" is out of range");
     }
+}
 
-    time_check(S.scheduled_departure_time.hour, S.scheduled_departure_time.minute);
+/* Field splitting
+   split_sailing_fields walks a line once, in blocks of scan_block_size
+   bytes, and for every block builds three bit masks: commas, newlines, and
+   "content" bytes (anything that is neither a comma nor whitespace in the
+   sense of std::isspace in the C locale: ' ', '\t', '\n', '\v', '\f', '\r').
+   A field is blank exactly when no content bit falls between its commas, so
+   the empty-field check needs no second pass over the text. Blocks use AVX2
+   when the compiler targets it, otherwise SSE2, and the tail of the line
+   (or the whole line on other CPUs) is handled one byte at a time. */
+#if defined(__AVX2__)
+const size_t scan_block_size{ 32 };
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+const size_t scan_block_size{ 16 };
+#else
+const size_t scan_block_size{ 0 };
+#endif
 
-    return S;
+struct ScanMasks
+{
+    std::uint32_t commas{ 0 };
+    std::uint32_t newlines{ 0 };
+    std::uint32_t content{ 0 };
+};
+
+#if defined(__AVX2__)
+ScanMasks scan_block(const char* block) noexcept {
+    const __m256i bytes{ _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block)) };
+    const __m256i commas{ _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(',')) };
+    const __m256i newlines{ _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')) };
+    /* '\t'..'\r' are the bytes whose value minus 9 is at most 4 (unsigned). */
+    const __m256i shifted{ _mm256_sub_epi8(bytes, _mm256_set1_epi8(9)) };
+    const __m256i control_space{ _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(4)), shifted) };
+    const __m256i space{ _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')), control_space) };
 
+    ScanMasks masks{};
+    masks.commas = static_cast<std::uint32_t>(_mm256_movemask_epi8(commas));
+    masks.newlines = static_cast<std::uint32_t>(_mm256_movemask_epi8(newlines));
+    masks.content = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(space, commas)));
+    return masks;
 }
-bool check_space_errors(const std::string& el) {
-    bool space{ false };
-    for (size_t i{ 0 }; i < el.size(); i++) {
-        if (!std::isspace(el.at(i))) {
-            space = false;
-            break;
-        }
-        else {
-            space = true;
-        }
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+ScanMasks scan_block(const char* block) noexcept {
+    const __m128i bytes{ _mm_loadu_si128(reinterpret_cast<const __m128i*>(block)) };
+    const __m128i commas{ _mm_cmpeq_epi8(bytes, _mm_set1_epi8(',')) };
+    const __m128i newlines{ _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')) };
+    /* '\t'..'\r' are the bytes whose value minus 9 is at most 4 (unsigned). */
+    const __m128i shifted{ _mm_sub_epi8(bytes, _mm_set1_epi8(9)) };
+    const __m128i control_space{ _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(4)), shifted) };
+    const __m128i space{ _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')), control_space) };
+
+    ScanMasks masks{};
+    masks.commas = static_cast<std::uint32_t>(_mm_movemask_epi8(commas));
+    masks.newlines = static_cast<std::uint32_t>(_mm_movemask_epi8(newlines));
+    masks.content = ~static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_or_si128(space, commas))) & 0xFFFFu;
+    return masks;
+}
+#endif
 
+/* Index of the lowest set bit of a non-zero mask. */
+unsigned int lowest_bit(std::uint32_t mask) noexcept {
+#if defined(_MSC_VER)
+    unsigned long index{ 0 };
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned int>(index);
+#else
+    return static_cast<unsigned int>(__builtin_ctz(mask));
+#endif
+}
+
+bool is_space_byte(char c) noexcept {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/* Record the field [split.field_start, end) of text and start the next one. */
+void end_field(std::string_view text, size_t end, bool has_content, FieldSplit& split) noexcept {
+    if (split.count < sailing_field_count) {
+        split.fields[split.count] = text.substr(split.field_start, end - split.field_start);
+        if (!has_content)
+            split.blank_fields |= 1u << split.count;
     }
-    return space;
+    split.count++;
+    split.field_start = end + 1;
 }
 
-int convert_to_int_and_check(const std::string& str) {
-    int i{};
-    try {
-        i = stoi(str);
+/* split_sailing_fields<StopAtNewline>(text, split)
+   Split text into comma-separated fields, filling split with the first
+   sailing_field_count fields, the total field count and the blank-field
+   mask. With StopAtNewline the line ends at the first '\n', and the length
+   of the line (excluding the newline) is returned; otherwise all of text is
+   one line, as for parse_sailing, and text.size() is returned. */
+template <bool StopAtNewline>
+size_t split_sailing_fields(std::string_view text, FieldSplit& split) noexcept {
+    split = FieldSplit{};
+    bool has_content{ false };
+    size_t pos{ 0 };
+
+    if (scan_block_size > 0) {
+        while (pos + scan_block_size <= text.size()) {
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+            const ScanMasks masks{ scan_block(text.data() + pos) };
+            std::uint32_t stops{ StopAtNewline ? (masks.commas | masks.newlines) : masks.commas };
+            /* Content bits at or after bit `from` belong to the current field. */
+            std::uint64_t content{ masks.content };
+            while (stops != 0) {
+                const unsigned int bit{ lowest_bit(stops) };
+                has_content = has_content || (content & ((std::uint64_t{ 1 } << bit) - 1)) != 0;
+                content &= ~((std::uint64_t{ 1 } << (bit + 1)) - 1);
+                end_field(text, pos + bit, has_content, split);
+                has_content = false;
+                if (StopAtNewline && (masks.newlines & (1u << bit)) != 0)
+                    return pos + bit;
+                stops &= stops - 1;
+            }
+            has_content = has_content || content != 0;
+#endif
+            pos += scan_block_size;
+        }
     }
-    catch (std::invalid_argument &) {
-        const NonNumericDataException e{ str };
 
-        throw e;
+    for (; pos < text.size(); pos++) {
+        const char c{ text[pos] };
+        if (c == ',' || (StopAtNewline && c == '\n')) {
+            end_field(text, pos, has_content, split);
+            has_content = false;
+            if (c == '\n')
+                return pos;
+        }
+        else if (!is_space_byte(c)) {
+            has_content = true;
+        }
     }
-    return i;
+    end_field(text, text.size(), has_content, split);
+    return text.size();
 }
 
-void time_check(const int hour, const int minute) {
-    if (!(hour <= 23 && hour >= 0 && minute <= 59 && minute >= 0)) {
-        const InvalidTimeException e{ hour, minute };
+/* Parse the leading integer of str into value with the same rules as
+   std::stoi (leading whitespace, optional sign, trailing text ignored), but
+   with std::from_chars and without constructing a std::string. Returns
+   NonNumericData if str does not start with a number and OutOfRange if the
+   number does not fit in an int. */
+ParseErrorKind parse_int_field(std::string_view str, int& value) noexcept {
+    size_t pos{ 0 };
+    while (pos < str.size() && std::isspace(static_cast<unsigned char>(str[pos])))
+        pos++;
 
-        throw e;
+    bool negative{ false };
+    if (pos < str.size() && (str[pos] == '+' || str[pos] == '-')) {
+        negative = str[pos] == '-';
+        pos++;
     }
 
+    if (pos == str.size() || !std::isdigit(static_cast<unsigned char>(str[pos])))
+        return ParseErrorKind::NonNumericData;
+
+    long long magnitude{ 0 };
+    const auto result{ std::from_chars(str.data() + pos, str.data() + str.size(), magnitude) };
+    const long long limit{ negative ? static_cast<long long>(INT_MAX) + 1 : INT_MAX };
+    if (result.ec == std::errc::result_out_of_range || magnitude > limit)
+        return ParseErrorKind::OutOfRange;
+
+    value = static_cast<int>(negative ? -magnitude : magnitude);
+    return ParseErrorKind::None;
+}
+
+/* A valid departure time is a 24-hour clock time. */
+bool is_valid_time(const int hour, const int minute) noexcept {
+    return hour <= 23 && hour >= 0 && minute <= 59 && minute >= 0;
 }
 
 /* performance_by_route(sailings)
@@ -303,40 +1035,109 @@ void time_check(const int hour, const int minute) {
 */
 std::vector<RouteStatistics> performance_by_route(std::vector<Sailing> const& sailings)
 {
-    /* Your Code Here */
-    std::vector <RouteStatistics> RS;
-    
+    return aggregate_routes_in_parallel(sailings.size(), [&sailings](size_t begin, size_t end, RouteAggregate& aggregate) {
+        aggregate_routes(sailings, begin, end, aggregate);
+    }).routes;
 
+}
 
-    for (size_t i{ 0 }; i < sailings.size(); i++) {
-        bool in{ false };
-        for (size_t j{ 0 }; j < RS.size(); j++) {
-            if (sailings.at(i).route_number == RS.at(j).route_number) {
-                in = true;
-                RS.at(j).total_sailings++;
-                if (sailings.at(i).actual_duration - sailings.at(i).expected_duration >= 5) {
-                    RS.at(j).late_sailings++;
-                }
-                break;
-            }
+/* performance_by_route(table)
+   Same result as performance_by_route(sailings) for column storage; only the
+   route number and duration columns are read. */
+std::vector<RouteStatistics> performance_by_route(SailingTable const& table)
+{
+    return aggregate_routes_in_parallel(table_size(table), [&table](size_t begin, size_t end, RouteAggregate& aggregate) {
+        aggregate_routes(table, begin, end, aggregate);
+    }).routes;
+}
 
-        }
+/* aggregate_routes_in_parallel(count, aggregate_slice)
+   Split the records [0, count) into one contiguous slice per worker and
+   call aggregate_slice(begin, end, aggregate) for each slice with a private
+   RouteAggregate, so there is no sharing between threads until the final
+   merge. Merging in slice order keeps routes in the order they first
+   appear in the input, as a single sequential scan would. */
+template <typename SliceAggregator>
+RouteAggregate aggregate_routes_in_parallel(size_t count, SliceAggregator aggregate_slice)
+{
+    const size_t workers{ worker_count(count) };
+    std::vector<RouteAggregate> partials(workers);
 
-        if (!in) {
-            RouteStatistics temp{};
-            temp.route_number = sailings.at(i).route_number;
-            temp.total_sailings++;
-            if (sailings.at(i).actual_duration - sailings.at(i).expected_duration >= 5) {
-                temp.late_sailings++;
-            }
-            RS.push_back(temp);
+    const size_t slice{ (count + workers - 1) / workers };
+    run_workers(workers, [&aggregate_slice, &partials, count, slice](size_t w) {
+        const size_t begin{ std::min(count, w * slice) };
+        const size_t end{ std::min(count, begin + slice) };
+        aggregate_slice(begin, end, partials.at(w));
+    });
+
+    RouteAggregate total{ std::move(partials.at(0)) };
+    for (size_t w{ 1 }; w < workers; w++)
+        merge_route_aggregate(total, partials.at(w));
+    return total;
+}
+
+/* Number of threads to use for a pass over items records: one per hardware
+   thread, but never so many that a thread gets less than min_items_per_worker. */
+size_t worker_count(size_t items, size_t min_items_per_worker) {
+    const size_t hardware{ std::max<size_t>(1, std::thread::hardware_concurrency()) };
+    return std::max<size_t>(1, std::min(hardware, items / min_items_per_worker));
+}
+
+/* Find (or create) the entry for route_number in the aggregate. Route
+   numbers in [0, dense_route_limit) are looked up by direct indexing; any
+   others fall back to a hash table. */
+RouteStatistics& route_entry(RouteAggregate& aggregate, int route_number) {
+    size_t position{ 0 };
+    if (route_number >= 0 && route_number < dense_route_limit) {
+        const size_t slot{ static_cast<size_t>(route_number) };
+        if (slot >= aggregate.dense_index.size())
+            aggregate.dense_index.resize(slot + 1, 0);
+        if (aggregate.dense_index[slot] == 0) {
+            aggregate.routes.push_back(RouteStatistics{ route_number, 0, 0 });
+            aggregate.dense_index[slot] = aggregate.routes.size();
         }
+        position = aggregate.dense_index[slot] - 1;
+    }
+    else {
+        const auto found{ aggregate.sparse_index.try_emplace(route_number, aggregate.routes.size()) };
+        if (found.second)
+            aggregate.routes.push_back(RouteStatistics{ route_number, 0, 0 });
+        position = found.first->second;
     }
-    return RS;
+    return aggregate.routes[position];
+}
 
+void add_route_sailing(RouteAggregate& aggregate, int route_number, bool late) {
+    RouteStatistics& stat{ route_entry(aggregate, route_number) };
+    stat.total_sailings++;
+    if (late)
+        stat.late_sailings++;
 }
 
-/* best_days(sailings)
+/* Fold sailings [begin, end) into aggregate. */
+void aggregate_routes(std::vector<Sailing> const& sailings, size_t begin, size_t end, RouteAggregate& aggregate) {
+    for (size_t i{ begin }; i < end; i++) {
+        const Sailing& sailing{ sailings[i] };
+        add_route_sailing(aggregate, sailing.route_number, is_late_sailing(sailing.expected_duration, sailing.actual_duration));
+    }
+}
+
+void aggregate_routes(SailingTable const& table, size_t begin, size_t end, RouteAggregate& aggregate) {
+    for (size_t i{ begin }; i < end; i++)
+        add_route_sailing(aggregate, table.route_number[i], is_late_sailing(table.expected_duration[i], table.actual_duration[i]));
+}
+
+/* Add the totals in from to into. Routes that are new to into are appended
+   in the order they appear in from. Only from.routes is read. */
+void merge_route_aggregate(RouteAggregate& into, RouteAggregate const& from) {
+    for (const RouteStatistics& stat : from.routes) {
+        RouteStatistics& entry{ route_entry(into, stat.route_number) };
+        entry.total_sailings += stat.total_sailings;
+        entry.late_sailings += stat.late_sailings;
+    }
+}
+
+/* best_days(sailings)
    Recall that a sailing is considered "late" if
     actual_duration >= expected_duration + 5
 
@@ -361,63 +1162,219 @@ std::vector<RouteStatistics> performance_by_route(std::vector<Sailing> const& sa
 */
 std::vector<DayStatistics> best_days(std::vector<Sailing> const& sailings)
 {
-    /* Your Code Here */
+    return best_days(aggregate_days(sailings));
+}
 
-    std::vector <DayStatistics> best_days{};
-    std::vector <ratio_DayStat> rds{};
-    for (size_t i = 0; i < sailings.size(); i++)
-    {
-        bool in{ false };
-        for (size_t j = 0; j < rds.size(); j++)
-        {
-            if (cmp_date(sailings.at(i).departure_date, rds.at(j).date)) {
-                in = true;
-                update_ratio_struct(rds.at(j), sailings.at(i));
-                break;
-            }
+std::vector<DayStatistics> best_days(SailingTable const& table)
+{
+    return best_days(aggregate_days(table));
+}
 
-        }
-        
-        if (!in) {
-            ratio_DayStat temp{ {sailings.at(i).departure_date.day,sailings.at(i).departure_date.month,sailings.at(i).departure_date.year},0,0,0 };
-            rds.push_back(temp);
-            update_ratio_struct(rds.back(), sailings.at(i));
+/* best_days(aggregate)
+   Same as best_days(sailings), answered from an existing DayAggregate so that
+   the per-day totals are only built once when several queries are made. */
+std::vector<DayStatistics> best_days(DayAggregate const& aggregate)
+{
+    return select_days(aggregate, compare_day_ratio);
+}
+
+/* Return true if a sailing with these durations counts as late. */
+bool is_late_sailing(int expected_duration, int actual_duration) {
+    return actual_duration - expected_duration >= 5;
+}
+
+bool cmp_date(const Date& date1, const Date& date2) {
+    if (date1.day == date2.day && date1.month == date2.month && date1.year == date2.year)
+        return true;
+    else
+        return false;
+}
+
+/* Pack a Date into a single 64-bit value for hashing: the year takes the high
+   32 bits and the month and day 16 bits each. Equality is still decided by
+   cmp_date, so out-of-range fields can only cause a hash collision. */
+std::uint64_t pack_date(const Date& date) {
+    return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(date.year)) << 32)
+        | (static_cast<std::uint64_t>(static_cast<std::uint16_t>(date.month)) << 16)
+        | static_cast<std::uint64_t>(static_cast<std::uint16_t>(date.day));
+}
+
+/* Find (or create) the entry for date in the aggregate, by day number
+   when the date has one in the dense range and through the hash table
+   otherwise. */
+DayStatistics& day_entry(DayAggregate& aggregate, const Date& date) {
+    if (has_day_number(date)) {
+        const DayNumber day_number{ to_day_number(date) };
+        if (day_number >= 0 && day_number < dense_day_limit) {
+            const size_t slot{ static_cast<size_t>(day_number) };
+            if (slot >= aggregate.dense_index.size())
+                aggregate.dense_index.resize(slot + 1, 0);
+            if (aggregate.dense_index[slot] == 0) {
+                aggregate.days.push_back(DayStatistics{ date, 0, 0 });
+                aggregate.dense_index[slot] = aggregate.days.size();
+            }
+            return aggregate.days[aggregate.dense_index[slot] - 1];
         }
     }
-    double sailing_ratio{ rds.at(0).ratio };
-    for (ratio_DayStat stat : rds)
-    {
-        if (stat.ratio < sailing_ratio)
-            sailing_ratio = stat.ratio;
+    const auto found{ aggregate.sparse_index.try_emplace(date, aggregate.days.size()) };
+    if (found.second)
+        aggregate.days.push_back(DayStatistics{ date, 0, 0 });
+    return aggregate.days[found.first->second];
+}
+
+/* radix_sort_order(keys, order)
+   Sort keys, and order along with it, least significant byte first,
+   skipping bytes that are the same for every key. The sort is stable and
+   takes linear time. */
+template <typename Key>
+void radix_sort_order(std::vector<Key>& keys, std::vector<size_t>& order) {
+    std::vector<Key> sorted_keys(keys.size());
+    std::vector<size_t> sorted_order(order.size());
+    for (int shift{ 0 }; shift < static_cast<int>(sizeof(Key) * 8); shift += 8) {
+        size_t counts[257]{};
+        for (Key key : keys)
+            counts[((key >> shift) & 0xFF) + 1]++;
+        if (std::count(std::begin(counts), std::end(counts), static_cast<size_t>(keys.size())) == 1)
+            continue;
+        for (int b{ 0 }; b < 256; b++)
+            counts[b + 1] += counts[b];
+        for (size_t i{ 0 }; i < keys.size(); i++) {
+            const size_t position{ counts[(keys[i] >> shift) & 0xFF]++ };
+            sorted_keys[position] = keys[i];
+            sorted_order[position] = order[i];
+        }
+        keys.swap(sorted_keys);
+        order.swap(sorted_order);
     }
+}
 
-    for (ratio_DayStat stat : rds)
-    {
-        if (stat.ratio == sailing_ratio) {
-            DayStatistics temp{};
-            temp.date.day = stat.date.day;
-            temp.date.month = stat.date.month;
-            temp.date.year = stat.date.year;
-            temp.total_sailings = stat.total_sailings;
-            temp.late_sailings = stat.late_sailings;
-            best_days.push_back(temp);
+/* chronological_order(days)
+   The positions of days sorted by date, in linear time. Days with a day
+   number are radix-sorted on it a byte at a time (skipping bytes that
+   are the same for every day); the few dates that are not calendar dates
+   are sorted by (year, month, day) and merged in, which for calendar
+   dates is the same order as by day number. */
+std::vector<size_t> chronological_order(std::vector<DayStatistics> const& days) {
+    std::vector<std::uint32_t> keys{};
+    std::vector<size_t> order{};
+    std::vector<size_t> others{};
+    for (size_t i{ 0 }; i < days.size(); i++) {
+        if (has_day_number(days[i].date)) {
+            keys.push_back(static_cast<std::uint32_t>(to_day_number(days[i].date)) ^ 0x80000000u);
+            order.push_back(i);
+        }
+        else {
+            others.push_back(i);
         }
     }
 
-    return best_days;
+    radix_sort_order(keys, order);
+
+    const auto date_less{ [&days](size_t a, size_t b) {
+        const Date& date1{ days[a].date };
+        const Date& date2{ days[b].date };
+        if (date1.year != date2.year)
+            return date1.year < date2.year;
+        return date1.month != date2.month ? date1.month < date2.month : date1.day < date2.day;
+    } };
+    std::sort(others.begin(), others.end(), date_less);
+    std::vector<size_t> merged(days.size());
+    std::merge(order.begin(), order.end(), others.begin(), others.end(), merged.begin(), date_less);
+    return merged;
 }
-bool cmp_date(const Date& date1, const Date& date2) {
-    if (date1.day == date2.day && date1.month == date2.month && date1.year == date2.year)
-        return true;
-    else
-        return false;
+
+/* The days of aggregate in date order. */
+std::vector<DayStatistics> days_by_date(DayAggregate const& aggregate) {
+    std::vector<DayStatistics> sorted{};
+    sorted.reserve(aggregate.days.size());
+    for (size_t i : chronological_order(aggregate.days))
+        sorted.push_back(aggregate.days[i]);
+    return sorted;
 }
-void update_ratio_struct(ratio_DayStat& stat, const Sailing& sailing) {
-   
+
+/* Add one sailing on the given date to the aggregate. */
+void add_day_sailing(DayAggregate& aggregate, const Date& date, bool late) {
+    DayStatistics& stat{ day_entry(aggregate, date) };
     stat.total_sailings++;
-    if (sailing.actual_duration - sailing.expected_duration >= 5)
+    if (late)
         stat.late_sailings++;
-    stat.ratio = (double)stat.late_sailings /(double) stat.total_sailings;
+}
+
+/* Add the totals in from to into. Days that are new to into are appended
+   in the order they appear in from. Only from.days is read. */
+void merge_day_aggregate(DayAggregate& into, DayAggregate const& from) {
+    for (const DayStatistics& stat : from.days) {
+        DayStatistics& entry{ day_entry(into, stat.date) };
+        entry.total_sailings += stat.total_sailings;
+        entry.late_sailings += stat.late_sailings;
+    }
+}
+
+/* aggregate_days(sailings)
+   Build the per-day totals for all sailings in one pass. Days appear in the
+   result in the order they are first seen in the input. */
+DayAggregate aggregate_days(std::vector<Sailing> const& sailings) {
+    DayAggregate aggregate{};
+    for (const Sailing& sailing : sailings)
+        add_day_sailing(aggregate, sailing.departure_date, is_late_sailing(sailing.expected_duration, sailing.actual_duration));
+    return aggregate;
+}
+
+/* aggregate_days(table)
+   Same as aggregate_days(sailings) for column storage; only the date and
+   duration columns are read. */
+DayAggregate aggregate_days(SailingTable const& table) {
+    DayAggregate aggregate{};
+    for (size_t i{ 0 }; i < table_size(table); i++)
+        add_day_sailing(aggregate, Date{ table.day[i], table.month[i], table.year[i] }, is_late_sailing(table.expected_duration[i], table.actual_duration[i]));
+    return aggregate;
+}
+
+/* Compare the late ratios of two days exactly, by cross-multiplying the
+   integer counts instead of dividing. Returns a negative value if day1 has
+   the lower ratio, zero if the ratios are equal and a positive value if
+   day1 has the higher ratio. */
+int compare_day_ratio(const DayStatistics& day1, const DayStatistics& day2) {
+    return compare_late_ratio(day1, day2);
+}
+
+/* The same exact comparison for anything with late_sailings and
+   total_sailings counts (days, routes, groups). */
+template <typename Statistics>
+int compare_late_ratio(const Statistics& stats1, const Statistics& stats2) {
+    const long long lhs{ static_cast<long long>(stats1.late_sailings) * stats2.total_sailings };
+    const long long rhs{ static_cast<long long>(stats2.late_sailings) * stats1.total_sailings };
+    return lhs < rhs ? -1 : (lhs > rhs ? 1 : 0);
+}
+
+/* Reverse of compare_day_ratio: the day with the higher ratio ranks first. */
+int compare_day_ratio_descending(const DayStatistics& day1, const DayStatistics& day2) {
+    return compare_day_ratio(day2, day1);
+}
+
+/* select_days(aggregate, ranking)
+   Return every day that ranks first under ranking, in first-seen order.
+   ranking(a, b) must return a negative value when a ranks ahead of b and
+   zero when they tie; best_days and worst_days are the two built-in
+   rankings, and any other ordering can be passed the same way. */
+template <typename Ranking>
+std::vector<DayStatistics> select_days(DayAggregate const& aggregate, Ranking ranking) {
+    std::vector<DayStatistics> selected{};
+    for (const DayStatistics& stat : aggregate.days) {
+        if (selected.empty()) {
+            selected.push_back(stat);
+            continue;
+        }
+        const int order{ ranking(stat, selected.front()) };
+        if (order < 0) {
+            selected.clear();
+            selected.push_back(stat);
+        }
+        else if (order == 0) {
+            selected.push_back(stat);
+        }
+    }
+    return selected;
 }
 
 
@@ -442,48 +1399,84 @@ void update_ratio_struct(ratio_DayStat& stat, const Sailing& sailing) {
 */
 std::vector<DayStatistics> worst_days(std::vector<Sailing> const& sailings)
 {
-    /* Your Code Here */
-    std::vector <DayStatistics> worst_days;
-    std::vector <ratio_DayStat> rds{};
-    for (size_t i = 0; i < sailings.size(); i++)
-    {
-        bool in{ false };
-        for (size_t j = 0; j < rds.size(); j++)
-        {
-            if (cmp_date(sailings.at(i).departure_date, rds.at(j).date)) {
-                in = true;
-                update_ratio_struct(rds.at(j), sailings.at(i));
-                break;
-            }
+    return worst_days(aggregate_days(sailings));
+}
 
+std::vector<DayStatistics> worst_days(SailingTable const& table)
+{
+    return worst_days(aggregate_days(table));
+}
+
+/* worst_days(aggregate)
+   Same as worst_days(sailings), answered from an existing DayAggregate. */
+std::vector<DayStatistics> worst_days(DayAggregate const& aggregate)
+{
+    return select_days(aggregate, compare_day_ratio_descending);
+}
+
+/* select_top(candidates, count, min_sailings, ranking)
+   Return the count candidates that rank first under ranking (see
+   select_days), best first, skipping any with fewer than min_sailings
+   sailings. Candidates that tie keep their order in the input, so the
+   result is the same on every run. Only count candidates are held at a
+   time, in a heap whose top is the lowest-ranked one kept so far, so this
+   takes O(n log count) time. */
+template <typename Statistics, typename Ranking>
+std::vector<Statistics> select_top(std::vector<Statistics> const& candidates, size_t count, int min_sailings, Ranking ranking) {
+    const auto ranks_ahead{ [&candidates, &ranking](size_t a, size_t b) {
+        const int order{ ranking(candidates[a], candidates[b]) };
+        return order < 0 || (order == 0 && a < b);
+    } };
+
+    std::vector<size_t> heap{};
+    heap.reserve(std::min(count, candidates.size()));
+    for (size_t i{ 0 }; i < candidates.size() && count > 0; i++) {
+        if (candidates[i].total_sailings < min_sailings)
+            continue;
+        if (heap.size() < count) {
+            heap.push_back(i);
+            std::push_heap(heap.begin(), heap.end(), ranks_ahead);
         }
-        if (!in) {
-            ratio_DayStat temp{ {sailings.at(i).departure_date.day,sailings.at(i).departure_date.month,sailings.at(i).departure_date.year},0,0,0 };
-            rds.push_back(temp);
-            update_ratio_struct(rds.back(), sailings.at(i));
-        }
-    }
-    double  sailing_ratio{ rds.at(0).ratio };
-    for (ratio_DayStat stat : rds)
-    {
-        if (stat.ratio > sailing_ratio)
-            sailing_ratio = stat.ratio;
-    }
-    
-    for (ratio_DayStat stat : rds)
-    {
-        if (stat.ratio == sailing_ratio) {
-            DayStatistics temp{};
-            temp.date.day = stat.date.day;
-            temp.date.month = stat.date.month;
-            temp.date.year = stat.date.year;
-            temp.total_sailings = stat.total_sailings;
-            temp.late_sailings = stat.late_sailings;
-            worst_days.push_back(temp);
+        else if (ranks_ahead(i, heap.front())) {
+            std::pop_heap(heap.begin(), heap.end(), ranks_ahead);
+            heap.back() = i;
+            std::push_heap(heap.begin(), heap.end(), ranks_ahead);
         }
     }
+    std::sort_heap(heap.begin(), heap.end(), ranks_ahead);
+
+    std::vector<Statistics> selected{};
+    selected.reserve(heap.size());
+    for (size_t i : heap)
+        selected.push_back(candidates[i]);
+    return selected;
+}
+
+/* best_days(aggregate, count, min_sailings) and worst_days(...)
+   The count days with the lowest (or highest) late ratio among days with at
+   least min_sailings sailings, best (or worst) first. */
+std::vector<DayStatistics> best_days(DayAggregate const& aggregate, size_t count, int min_sailings)
+{
+    return select_top(aggregate.days, count, min_sailings, compare_day_ratio);
+}
+
+std::vector<DayStatistics> worst_days(DayAggregate const& aggregate, size_t count, int min_sailings)
+{
+    return select_top(aggregate.days, count, min_sailings, compare_day_ratio_descending);
+}
 
-    return worst_days;
+/* best_routes(routes, count, min_sailings) and worst_routes(...)
+   The same rankings for the per-route totals from performance_by_route. */
+std::vector<RouteStatistics> best_routes(std::vector<RouteStatistics> const& routes, size_t count, int min_sailings)
+{
+    return select_top(routes, count, min_sailings, compare_late_ratio<RouteStatistics>);
+}
+
+std::vector<RouteStatistics> worst_routes(std::vector<RouteStatistics> const& routes, size_t count, int min_sailings)
+{
+    return select_top(routes, count, min_sailings, [](const RouteStatistics& route1, const RouteStatistics& route2) {
+        return compare_late_ratio(route2, route1);
+    });
 }
 
 /* Provided functions (already implemented in a2_functions.cpp) */
@@ -492,44 +1485,28 @@ std::vector<DayStatistics> worst_days(std::vector<Sailing> const& sailings)
 std::vector<Sailing> read_sailings(std::string const& input_filename)
 {
     std::vector<Sailing> all_sailings;
+    stream_sailing_lines(input_filename, all_sailings, LoadReport{ std::cout });
+    return all_sailings;
+}
+
+/* Read input_filename line by line with std::getline and append every valid
+   sailing to sink (a std::vector<Sailing> or a SailingTable). */
+template <typename Sink>
+void stream_sailing_lines(std::string const& input_filename, Sink& sink, LoadReport const& report)
+{
     std::ifstream input_file;
     input_file.open(input_filename);
 
-    int valid_sailings{ 0 };
-    int total_lines{ 0 };
+    LoadCounts counts{};
 
     if (input_file.is_open())
     {
         std::string line;
         while (std::getline(input_file, line))
         {
-            total_lines++;
-            try
-            {
-                Sailing s{ parse_sailing(line) };
-                valid_sailings++;
-                all_sailings.push_back(s);
-            }
-            catch (IncompleteLineException& e)
-            {
-                std::cout << "Line " << total_lines << " is invalid: ";
-                std::cout << e.num_fields << " fields found." << std::endl;
-            }
-            catch (EmptyFieldException& e)
-            {
-                std::cout << "Line " << total_lines << " is invalid: ";
-                std::cout << "Field " << e.which_field << " is empty." << std::endl;
-            }
-            catch (NonNumericDataException& e)
-            {
-                std::cout << "Line " << total_lines << " is invalid: ";
-                std::cout << "\"" << e.bad_field << "\" is non-numeric." << std::endl;
-            }
-            catch (InvalidTimeException& e)
-            {
-                std::cout << "Line " << total_lines << " is invalid: ";
-                std::cout << e.bad_time.hour << ":" << e.bad_time.minute << " is not a valid time." << std::endl;
-            }
+            counts.total_lines++;
+            if (load_sailing_line(line, counts.total_lines, sink, report, counts.errors))
+                counts.valid_sailings++;
         }
         input_file.close();
     }
@@ -537,69 +1514,6067 @@ std::vector<Sailing> read_sailings(std::string const& input_filename)
     {
         throw std::runtime_error("Unable to open input file");
     }
+    print_load_summary(counts, report);
+}
+
+/* Parse one input line and append the result to sink. Invalid lines are
+   reported (see note_invalid_line) using the 1-based line_number, and false
+   is returned. */
+template <typename Sink>
+bool load_sailing_line(std::string_view line, int line_number, Sink& sink, LoadReport const& report, ErrorTally& errors)
+{
+    SailingView view{};
+    const ParseError error{ try_parse_sailing(line, view) };
+    if (error.kind == ParseErrorKind::None)
+    {
+        append_sailing(sink, view);
+        return true;
+    }
+    note_invalid_line(error, line_number, report, errors);
+    return false;
+}
+
+/* Write the "Line N is invalid" message for error to report. */
+void report_invalid_line(const ParseError& error, int line_number, std::ostream& report)
+{
+    switch (error.kind)
+    {
+    case ParseErrorKind::None:
+        return;
+    case ParseErrorKind::IncompleteLine:
+        report << "Line " << line_number << " is invalid: ";
+        report << error.num_fields << " fields found." << std::endl;
+        break;
+    case ParseErrorKind::EmptyField:
+        report << "Line " << line_number << " is invalid: ";
+        report << "Field " << error.which_field << " is empty." << std::endl;
+        break;
+    case ParseErrorKind::NonNumericData:
+        report << "Line " << line_number << " is invalid: ";
+        report << "\"" << error.bad_field << "\" is non-numeric." << std::endl;
+        break;
+    case ParseErrorKind::InvalidTime:
+        report << "Line " << line_number << " is invalid: ";
+        report << error.bad_time.hour << ":" << error.bad_time.minute << " is not a valid time." << std::endl;
+        break;
+    case ParseErrorKind::OutOfRange:
+        report << "Line " << line_number << " is invalid: ";
+        report << "\"" << error.bad_field << "\" is out of range." << std::endl;
+        break;
+    }
+}
+
+void print_load_summary(int valid_sailings, int total_lines, std::ostream& report)
+{
     int invalid_sailings{ total_lines - valid_sailings };
-    std::cout << "Read " << valid_sailings << " records." << std::endl;
-    std::cout << "Skipped " << invalid_sailings << " invalid records." << std::endl;
+    report << "Read " << valid_sailings << " records." << std::endl;
+    report << "Skipped " << invalid_sailings << " invalid records." << std::endl;
+}
+
+/* Error summaries
+   Dirty feeds can have millions of invalid lines, and writing a message for
+   each one costs more than parsing them. With --errors=summary the loaders
+   only count invalid lines, by exception and by field, and keep the first
+   few line numbers of each kind as samples; the breakdown is printed once,
+   after the load totals. The tallies of separately loaded ranges (threads,
+   blocks) are added in file order, so the samples are always the first
+   lines of the file. */
+
+/* The field an error is counted under in ErrorTally::fields. */
+size_t error_field_slot(const ParseError& error)
+{
+    const unsigned int field{ error.kind == ParseErrorKind::IncompleteLine ? error.num_fields : error.which_field };
+    return std::min<size_t>(field, error_field_slots - 1);
+}
+
+/* Count one invalid line in errors, and write its message to report.stream
+   (or keep it in report.kept_lines) unless report.summarize is set. Without
+   a summary, a number out of range for an int throws std::out_of_range, as
+   read_sailings does, unless report.keep_out_of_range is set; with one it
+   is counted like any other invalid line. */
+void note_invalid_line(const ParseError& error, int line_number, LoadReport const& report, ErrorTally& errors)
+{
+    const size_t kind{ static_cast<size_t>(error.kind) };
+    errors.lines[kind]++;
+    errors.fields[kind][error_field_slot(error)]++;
+    if (report.summarize)
+    {
+        if (errors.samples[kind].size() < report.samples)
+            errors.samples[kind].push_back(line_number);
+    }
+    else if (error.kind == ParseErrorKind::OutOfRange && !report.keep_out_of_range)
+        throw_parse_error(error);
+    else if (report.kept_lines != nullptr)
+        report.kept_lines->push_back(InvalidLine{ line_number, ParseError{ error.kind, error.num_fields, error.which_field, {}, error.bad_time },
+                                                  std::string{ error.bad_field } });
+    else
+        report_invalid_line(error, line_number, report.stream);
+}
+
+/* Add the counts of a load that followed into's in the file, keeping at
+   most samples sample lines of each kind. */
+void add_load_counts(LoadCounts& into, LoadCounts const& from, size_t samples)
+{
+    into.valid_sailings += from.valid_sailings;
+    into.total_lines += from.total_lines;
+    for (size_t kind{ 0 }; kind < parse_error_kinds; kind++)
+    {
+        into.errors.lines[kind] += from.errors.lines[kind];
+        for (size_t slot{ 0 }; slot < error_field_slots; slot++)
+            into.errors.fields[kind][slot] += from.errors.fields[kind][slot];
+        std::vector<int>& kept{ into.errors.samples[kind] };
+        for (size_t i{ 0 }; i < from.errors.samples[kind].size() && kept.size() < samples; i++)
+            kept.push_back(from.errors.samples[kind][i]);
+    }
+}
+
+/* Print the load totals, followed by the error breakdown if report asks
+   for a summary. */
+void print_load_summary(LoadCounts const& counts, LoadReport const& report)
+{
+    print_load_summary(counts.valid_sailings, counts.total_lines, report.stream);
+    if (report.summarize)
+        print_error_summary(counts.errors, report.stream);
+}
+
+/* Print one line per kind of error that occurred, named after the exception
+   parse_sailing throws for it, with the number of lines and the sample line
+   numbers, then a line with the counts by field (or, for incomplete lines,
+   by number of fields found). */
+void print_error_summary(ErrorTally const& errors, std::ostream& report)
+{
+    const char* const kind_names[parse_error_kinds]{ "", "IncompleteLineException", "EmptyFieldException",
+                                                     "NonNumericDataException", "InvalidTimeException", "std::out_of_range" };
+    for (size_t kind{ 1 }; kind < parse_error_kinds; kind++)
+    {
+        if (errors.lines[kind] == 0)
+            continue;
+        report << kind_names[kind] << ": " << errors.lines[kind] << " lines";
+        const char* separator{ " (first: " };
+        for (int line_number : errors.samples[kind])
+        {
+            report << separator << line_number;
+            separator = ", ";
+        }
+        report << (errors.samples[kind].empty() ? "" : ")") << std::endl;
+
+        const bool incomplete{ kind == static_cast<size_t>(ParseErrorKind::IncompleteLine) };
+        report << (incomplete ? "    by fields found: " : "    by field: ");
+        separator = "";
+        for (size_t slot{ 0 }; slot < error_field_slots; slot++)
+        {
+            if (errors.fields[kind][slot] == 0)
+                continue;
+            report << separator << slot << (slot + 1 == error_field_slots ? "+" : "") << ": " << errors.fields[kind][slot];
+            separator = ", ";
+        }
+        report << std::endl;
+    }
+}
+
+/* MappedFile
+   Read-only view of a whole input file. On POSIX systems the file is
+   memory-mapped, so the loader can parse it in place without copying;
+   elsewhere the contents are read into an owned buffer once. */
+class MappedFile
+{
+public:
+    explicit MappedFile(std::string const& filename)
+    {
+#ifdef _WIN32
+        std::ifstream input_file{ filename, std::ios::binary };
+        if (!input_file.is_open())
+            throw std::runtime_error("Unable to open input file");
+        std::ostringstream contents;
+        contents << input_file.rdbuf();
+        buffer_ = contents.str();
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+#else
+        const int fd{ ::open(filename.c_str(), O_RDONLY) };
+        if (fd < 0)
+            throw std::runtime_error("Unable to open input file");
+        struct stat info {};
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Unable to open input file");
+        }
+        size_ = static_cast<size_t>(info.st_size);
+        if (size_ > 0) {
+            void* mapping{ ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0) };
+            if (mapping == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Unable to map input file");
+            }
+            ::madvise(mapping, size_, MADV_SEQUENTIAL);
+            data_ = static_cast<const char*>(mapping);
+        }
+        ::close(fd);
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifndef _WIN32
+        if (data_ != nullptr)
+            ::munmap(const_cast<char*>(data_), size_);
+#endif
+    }
+
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    std::string_view contents() const
+    {
+        return std::string_view{ data_, size_ };
+    }
+
+private:
+    const char* data_{ nullptr };
+    size_t size_{ 0 };
+    std::string buffer_{};
+};
+
+/* read_sailings_mapped(input_filename)
+   Same result and console output as read_sailings, but the file is mapped
+   into memory and every line is handed to the parser as a std::string_view
+   into the mapping, so no per-line string is ever allocated. */
+std::vector<Sailing> read_sailings_mapped(std::string const& input_filename)
+{
+    std::vector<Sailing> all_sailings;
+    map_sailing_lines(input_filename, all_sailings, LoadReport{ std::cout });
     return all_sailings;
 }
 
-void print_sailing(Sailing const& sailing)
+/* Map input_filename and append every valid sailing to sink. Lines are split
+   exactly like std::getline: a trailing newline does not start a new line. */
+template <typename Sink>
+void map_sailing_lines(std::string const& input_filename, Sink& sink, LoadReport const& report)
 {
-    std::cout << "Route " << sailing.route_number;
-    std::cout << " (" << sailing.source_terminal << " -> " << sailing.dest_terminal << "): ";
-    std::cout << sailing.departure_date.year << "-";
-    std::cout << std::setfill('0') << std::setw(2) << sailing.departure_date.month << "-";
-    std::cout << std::setfill('0') << std::setw(2) << sailing.departure_date.day << " ";
-    std::cout << std::setfill('0') << std::setw(2) << sailing.scheduled_departure_time.hour << ":";
-    std::cout << std::setfill('0') << std::setw(2) << sailing.scheduled_departure_time.minute << " ";
-    std::cout << "[Vessel: " << sailing.vessel_name << "] ";
-    std::cout << sailing.actual_duration << " minutes (" << sailing.expected_duration << " expected)" << std::endl;
+    const MappedFile input_file{ input_filename };
+    const std::string_view contents{ input_file.contents() };
+
+    reserve_sailings(sink, static_cast<size_t>(std::count(contents.begin(), contents.end(), '\n')) + 1);
+
+    const LoadCounts counts{ load_sailing_text(contents, 1, sink, report) };
+    print_load_summary(counts, report);
 }
 
-int main(int argc, char** argv)
+/* Parse every line of text, numbering them from first_line_number, and
+   append the valid sailings to sink. */
+template <typename Sink>
+LoadCounts load_sailing_text(std::string_view text, int first_line_number, Sink& sink, LoadReport const& report)
 {
-    /* if (argc < 3)
-     {
-         std::cout << "Usage: ./assignment_2 action input_filename" << std::endl;
-         std::cout << "       where action is either 'route_summary' or 'days'" << std::endl;
-         return 1;
-     }*/
+    LoadCounts counts{};
+    FieldSplit split{};
+    SailingView view{};
+
+    /* The splitter finds the end of each line in the same pass that splits
+       its fields, so the text is only scanned once. */
+    size_t start{ 0 };
+    while (start < text.size())
+    {
+        const size_t length{ split_sailing_fields<true>(text.substr(start), split) };
+        const ParseError error{ parse_split_fields(split, view) };
+        if (error.kind == ParseErrorKind::None)
+        {
+            append_sailing(sink, view);
+            counts.valid_sailings++;
+        }
+        else
+        {
+            note_invalid_line(error, first_line_number + counts.total_lines, report, counts.errors);
+        }
+        counts.total_lines++;
+        start += length + 1;
+    }
+    return counts;
+}
 
-    std::string action{ "days" };
-    std::string input_filename{ "./data/10_Sept2017_Aug2022_AllRoutes.txt" };
+/* read_sailings_parallel(input_filename)
+   Same result and console output as read_sailings, using all hardware
+   threads; see map_sailing_lines_parallel. */
+std::vector<Sailing> read_sailings_parallel(std::string const& input_filename)
+{
+    std::vector<Sailing> all_sailings;
+    map_sailing_lines_parallel(input_filename, all_sailings, LoadReport{ std::cout });
+    return all_sailings;
+}
 
-    auto all_sailings{ read_sailings(input_filename) };
+/* map_sailing_lines_parallel(input_filename, sink, report)
+   Multi-threaded version of map_sailing_lines. The mapped file is cut into
+   one byte range per worker, each ending just after a newline. A first
+   parallel pass counts the newlines in every range, which gives the global
+   number of each range's first line; a second pass parses every range into
+   a private sink and report. The pieces are then appended in file order, so
+   both the records and the "Line N is invalid" messages come out exactly as
+   the sequential loader produces them. */
+template <typename Sink>
+void map_sailing_lines_parallel(std::string const& input_filename, Sink& sink, LoadReport const& report)
+{
+    const size_t min_bytes_per_worker{ 1 << 22 };
 
-    if (action == "route_summary")
+    const MappedFile input_file{ input_filename };
+    const std::string_view contents{ input_file.contents() };
+    const size_t workers{ worker_count(contents.size(), min_bytes_per_worker) };
+
+    std::vector<size_t> boundaries{ 0 };
+    for (size_t w{ 1 }; w < workers; w++)
     {
-        std::cout << "Performance by route:" << std::endl;
-        auto statistics{ performance_by_route(all_sailings) };
-        for (auto stats : statistics)
+        size_t boundary{ std::max(boundaries.back(), contents.size() / workers * w) };
+        if (boundary > 0 && boundary < contents.size())
         {
-            std::cout << "Route " << stats.route_number << ": " << stats.total_sailings << " sailings (" << stats.late_sailings << " late)" << std::endl;
+            const size_t newline{ contents.find('\n', boundary - 1) };
+            boundary = newline == std::string_view::npos ? contents.size() : newline + 1;
         }
+        boundaries.push_back(boundary);
     }
-    else if (action == "days")
+    boundaries.push_back(contents.size());
+
+    std::vector<std::string_view> ranges{};
+    for (size_t w{ 0 }; w < workers; w++)
+        ranges.push_back(contents.substr(boundaries.at(w), boundaries.at(w + 1) - boundaries.at(w)));
+
+    std::vector<size_t> newlines(workers, 0);
+    run_workers(workers, [&ranges, &newlines](size_t w) {
+        newlines.at(w) = static_cast<size_t>(std::count(ranges.at(w).begin(), ranges.at(w).end(), '\n'));
+    });
+
+    std::vector<int> first_lines(workers, 1);
+    for (size_t w{ 1 }; w < workers; w++)
+        first_lines.at(w) = first_lines.at(w - 1) + static_cast<int>(newlines.at(w - 1));
+
+    std::vector<Sink> pieces(workers);
+    std::vector<std::ostringstream> reports(workers);
+    std::vector<LoadCounts> counts(workers);
+    run_workers(workers, [&](size_t w) {
+        reserve_sailings(pieces.at(w), newlines.at(w) + 1);
+        const LoadReport range_report{ reports.at(w), report.summarize, report.samples };
+        counts.at(w) = load_sailing_text(ranges.at(w), first_lines.at(w), pieces.at(w), range_report);
+    });
+
+    LoadCounts total{};
+    for (size_t w{ 0 }; w < workers; w++)
     {
-        auto best{ best_days(all_sailings) };
-        auto worst{ worst_days(all_sailings) };
-        std::cout << "Best days:" << std::endl;
-        for (auto stats : best)
+        append_sailings(sink, std::move(pieces.at(w)));
+        report.stream << reports.at(w).str();
+        add_load_counts(total, counts.at(w), report.samples);
+    }
+    print_load_summary(total, report);
+}
+
+/* Run task(w) for w in [0, workers), each on its own thread (the calling
+   thread takes w = 0), and wait for all of them. If any task throws, every
+   thread is still joined and the exception of the lowest w is rethrown. */
+template <typename Task>
+void run_workers(size_t workers, Task task)
+{
+    std::vector<std::exception_ptr> failures(std::max<size_t>(workers, 1));
+    const auto run{ [&task, &failures](size_t w) {
+        try
         {
-            std::cout << stats.date.year << "-" << stats.date.month << "-" << stats.date.day << ": ";
-            std::cout << stats.total_sailings << " sailings (" << stats.late_sailings << " late)" << std::endl;
+            task(w);
         }
-        std::cout << "Worst days:" << std::endl;
-        for (auto stats : worst)
+        catch (...)
         {
-            std::cout << stats.date.year << "-" << stats.date.month << "-" << stats.date.day << ": ";
-            std::cout << stats.total_sailings << " sailings (" << stats.late_sailings << " late)" << std::endl;
+            failures[w] = std::current_exception();
         }
+    } };
+
+    std::vector<std::thread> threads{};
+    size_t started{ 1 };
+    try
+    {
+        for (; started < workers; started++)
+            threads.emplace_back(run, started);
     }
-    else
+    catch (...)
+    {
+        failures[started] = std::current_exception();
+    }
+    run(0);
+    for (std::thread& thread : threads)
+        thread.join();
+    for (const std::exception_ptr& failure : failures)
     {
-        std::cout << "Invalid action " << action << std::endl;
+        if (failure)
+            std::rethrow_exception(failure);
     }
+}
 
-    return 0;
-}
\ No newline at end of file
+/* Read input_filename with the given loader, appending every valid sailing
+   to sink and writing the messages read_sailings prints to report. */
+template <typename Sink>
+void load_sailings_into(std::string const& input_filename, LoaderKind loader, Sink& sink, LoadReport const& report)
+{
+    switch (loader)
+    {
+    case LoaderKind::Stream:
+        stream_sailing_lines(input_filename, sink, report);
+        break;
+    case LoaderKind::Mapped:
+        map_sailing_lines(input_filename, sink, report);
+        break;
+    case LoaderKind::Parallel:
+        map_sailing_lines_parallel(input_filename, sink, report);
+        break;
+    case LoaderKind::Async:
+        read_sailing_blocks(input_filename, sink, report);
+        break;
+    }
+}
+
+/* read_sailing_table(input_filename, loader, report)
+   Load input_filename straight into column storage. The messages
+   read_sailings prints are written to report instead. No Sailing objects
+   are built along the way. */
+SailingTable read_sailing_table(std::string const& input_filename, LoaderKind loader, LoadReport const& report)
+{
+    SailingTable table{};
+    load_sailings_into(input_filename, loader, table, report);
+    return table;
+}
+
+/* read_sailing_chunks(input, sink, report)
+   Read input to the end in large blocks and append every valid sailing to
+   sink. Complete lines in each block are parsed in place; a line cut off at
+   the end of a block is carried over to the next one. Unlike
+   stream_sailing_lines this works on any stream, including std::cin, and
+   its memory use does not depend on the length of the input. */
+template <typename Sink>
+LoadCounts read_sailing_chunks(std::istream& input, Sink& sink, LoadReport const& report)
+{
+    const size_t block_size{ 1 << 20 };
+
+    LoadCounts counts{};
+    std::string buffer{};
+    size_t carried{ 0 };
+
+    while (input)
+    {
+        buffer.resize(carried + block_size);
+        input.read(&buffer[carried], static_cast<std::streamsize>(block_size));
+        const size_t filled{ carried + static_cast<size_t>(input.gcount()) };
+        const std::string_view text{ buffer.data(), filled };
+
+        /* At the end of the input the last line is parsed even without a
+           trailing newline, as std::getline would. */
+        const size_t last_newline{ text.rfind('\n') };
+        const size_t complete{ !input ? filled : (last_newline == std::string_view::npos ? 0 : last_newline + 1) };
+
+        const LoadCounts block{ load_sailing_text(text.substr(0, complete), counts.total_lines + 1, sink, report) };
+        add_load_counts(counts, block, report.samples);
+
+        carried = filled - complete;
+        std::copy(buffer.begin() + static_cast<std::ptrdiff_t>(complete), buffer.begin() + static_cast<std::ptrdiff_t>(filled), buffer.begin());
+    }
+    return counts;
+}
+
+/* Asynchronous block reader
+   --loader=async reads the file in async_block_size blocks and keeps up to
+   async_queue_depth of them in flight, so that while the parser works on
+   one block the kernel is already filling the next ones. On Linux the
+   reads go through io_uring, driven with the raw system calls so no extra
+   library is needed. Where io_uring is not available (older kernels,
+   sandboxes that forbid it, other systems) the reader falls back to plain
+   blocking pread calls with sequential read-ahead advice, and on Windows
+   to std::ifstream. Blocks are always handed out in file order. */
+const size_t async_block_size{ 1 << 22 };
+const size_t async_queue_depth{ 4 };
+
+#ifdef SAILING_IO_URING
+/* The parts of an io_uring instance the reader uses: the ring file
+   descriptor and the shared submission and completion rings. */
+struct IoUring
+{
+    int fd{ -1 };
+    void* sq_ring{ nullptr };
+    size_t sq_ring_size{ 0 };
+    void* cq_ring{ nullptr };
+    size_t cq_ring_size{ 0 };
+    io_uring_sqe* sqes{ nullptr };
+    size_t sqes_size{ 0 };
+    unsigned* sq_tail{ nullptr };
+    unsigned* sq_mask{ nullptr };
+    unsigned* sq_array{ nullptr };
+    unsigned* cq_head{ nullptr };
+    unsigned* cq_tail{ nullptr };
+    unsigned* cq_mask{ nullptr };
+    io_uring_cqe* cqes{ nullptr };
+};
+
+void close_io_uring(IoUring& ring)
+{
+    if (ring.sqes != nullptr)
+        ::munmap(ring.sqes, ring.sqes_size);
+    if (ring.cq_ring != nullptr && ring.cq_ring != ring.sq_ring)
+        ::munmap(ring.cq_ring, ring.cq_ring_size);
+    if (ring.sq_ring != nullptr)
+        ::munmap(ring.sq_ring, ring.sq_ring_size);
+    if (ring.fd >= 0)
+        ::close(ring.fd);
+    ring = IoUring{};
+}
+
+/* Set up ring with room for entries requests. Returns false (with ring
+   closed) if the kernel refuses. */
+bool open_io_uring(IoUring& ring, unsigned entries)
+{
+    io_uring_params params{};
+    ring.fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (ring.fd < 0)
+    {
+        ring = IoUring{};
+        return false;
+    }
+
+    ring.sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring.cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap{ (params.features & IORING_FEAT_SINGLE_MMAP) != 0 };
+    if (single_mmap)
+        ring.sq_ring_size = ring.cq_ring_size = std::max(ring.sq_ring_size, ring.cq_ring_size);
+
+    void* sq_ring{ ::mmap(nullptr, ring.sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING) };
+    if (sq_ring == MAP_FAILED)
+    {
+        close_io_uring(ring);
+        return false;
+    }
+    ring.sq_ring = sq_ring;
+    void* cq_ring{ single_mmap ? sq_ring : ::mmap(nullptr, ring.cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING) };
+    if (cq_ring == MAP_FAILED)
+    {
+        close_io_uring(ring);
+        return false;
+    }
+    ring.cq_ring = cq_ring;
+    ring.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes{ ::mmap(nullptr, ring.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES) };
+    if (sqes == MAP_FAILED)
+    {
+        close_io_uring(ring);
+        return false;
+    }
+    ring.sqes = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq{ static_cast<char*>(sq_ring) };
+    char* cq{ static_cast<char*>(cq_ring) };
+    ring.sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring.sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring.sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    ring.cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    ring.cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    ring.cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    ring.cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+#endif
+
+/* AsyncBlockReader
+   Reads a whole file as a sequence of blocks (see above). next() returns
+   the next block, or an empty view at the end of the file; the view is
+   valid until the following call. Throws std::runtime_error if the file
+   cannot be opened or read. */
+class AsyncBlockReader
+{
+public:
+    explicit AsyncBlockReader(std::string const& filename)
+    {
+#ifdef _WIN32
+        input_.open(filename, std::ios::binary);
+        if (!input_.is_open())
+            throw std::runtime_error("Unable to open input file");
+        slots_.resize(1);
+        slots_[0].buffer.resize(async_block_size);
+#else
+        fd_ = ::open(filename.c_str(), O_RDONLY);
+        if (fd_ < 0)
+            throw std::runtime_error("Unable to open input file");
+        /* The destructor does not run if the constructor throws, so a
+           failure past this point (a submission the kernel refuses, with
+           earlier reads already in flight) releases everything itself. */
+        try
+        {
+            struct stat info {};
+            if (::fstat(fd_, &info) != 0)
+                throw std::runtime_error("Unable to open input file");
+            size_ = static_cast<std::uint64_t>(info.st_size);
+#ifdef SAILING_IO_URING
+            if (open_io_uring(ring_, static_cast<unsigned>(async_queue_depth)))
+            {
+                slots_.resize(async_queue_depth);
+                for (Slot& slot : slots_)
+                {
+                    slot.buffer.resize(async_block_size);
+                    submit_block(slot);
+                }
+                return;
+            }
+#endif
+#ifdef POSIX_FADV_SEQUENTIAL
+            ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+            slots_.resize(1);
+            slots_[0].buffer.resize(async_block_size);
+        }
+        catch (...)
+        {
+            release();
+            throw;
+        }
+#endif
+    }
+
+    ~AsyncBlockReader()
+    {
+        release();
+    }
+
+    AsyncBlockReader(AsyncBlockReader const&) = delete;
+    AsyncBlockReader& operator=(AsyncBlockReader const&) = delete;
+
+    /* True if reads go through io_uring rather than the fallback. */
+    bool is_async() const
+    {
+#ifdef SAILING_IO_URING
+        return ring_.fd >= 0;
+#else
+        return false;
+#endif
+    }
+
+    std::string_view next()
+    {
+#ifdef _WIN32
+        Slot& slot{ slots_[0] };
+        input_.read(slot.buffer.data(), static_cast<std::streamsize>(slot.buffer.size()));
+        return std::string_view{ slot.buffer.data(), static_cast<size_t>(input_.gcount()) };
+#else
+#ifdef SAILING_IO_URING
+        if (ring_.fd >= 0)
+            return next_async();
+#endif
+        Slot& slot{ slots_[0] };
+        const size_t length{ static_cast<size_t>(std::min<std::uint64_t>(slot.buffer.size(), size_ - std::min(size_, next_offset_))) };
+        size_t filled{ 0 };
+        while (filled < length)
+        {
+            const ssize_t got{ ::pread(fd_, slot.buffer.data() + filled, length - filled, static_cast<off_t>(next_offset_ + filled)) };
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got < 0)
+                throw std::runtime_error("Unable to read input file");
+            if (got == 0)
+                break;
+            filled += static_cast<size_t>(got);
+        }
+        next_offset_ += filled;
+        return std::string_view{ slot.buffer.data(), filled };
+#endif
+    }
+
+private:
+    /* One buffer and the block it holds or is being filled with. */
+    struct Slot
+    {
+        std::vector<char> buffer{};
+        std::uint64_t offset{ 0 };
+        size_t length{ 0 };
+        size_t filled{ 0 };
+        bool in_flight{ false };
+#ifndef _WIN32
+        iovec request{};
+#endif
+    };
+
+    /* Wait for the reads still in flight, which write into the buffers,
+       then close the ring and the file. */
+    void release()
+    {
+#ifdef SAILING_IO_URING
+        if (ring_.fd >= 0)
+        {
+            while (std::any_of(slots_.begin(), slots_.end(), [](const Slot& slot) { return slot.in_flight; }))
+            {
+                if (!wait_for_completions())
+                    break;
+            }
+            close_io_uring(ring_);
+        }
+#endif
+#ifndef _WIN32
+        if (fd_ >= 0)
+            ::close(fd_);
+        fd_ = -1;
+#endif
+    }
+
+#ifdef SAILING_IO_URING
+    /* Start reading the next block of the file into slot, if any is left. */
+    void submit_block(Slot& slot)
+    {
+        slot.offset = next_offset_;
+        slot.length = static_cast<size_t>(std::min<std::uint64_t>(slot.buffer.size(), size_ - std::min(size_, next_offset_)));
+        slot.filled = 0;
+        next_offset_ += slot.length;
+        if (slot.length > 0)
+            submit_read(slot);
+    }
+
+    /* Queue a read of the unfilled part of slot. If the kernel refuses it,
+       slot is left idle and std::runtime_error is thrown. */
+    void submit_read(Slot& slot)
+    {
+        const unsigned tail{ *ring_.sq_tail };
+        const unsigned index{ tail & *ring_.sq_mask };
+        io_uring_sqe& sqe{ ring_.sqes[index] };
+        sqe = io_uring_sqe{};
+        slot.request.iov_base = slot.buffer.data() + slot.filled;
+        slot.request.iov_len = slot.length - slot.filled;
+        sqe.opcode = IORING_OP_READV;
+        sqe.fd = fd_;
+        sqe.off = slot.offset + slot.filled;
+        sqe.addr = reinterpret_cast<std::uint64_t>(&slot.request);
+        sqe.len = 1;
+        sqe.user_data = static_cast<std::uint64_t>(&slot - slots_.data());
+        ring_.sq_array[index] = index;
+        __atomic_store_n(ring_.sq_tail, tail + 1, __ATOMIC_RELEASE);
+        slot.in_flight = true;
+        while (::syscall(__NR_io_uring_enter, ring_.fd, 1, 0, 0, nullptr, 0) < 0)
+        {
+            if (errno != EINTR && errno != EAGAIN)
+            {
+                slot.in_flight = false;
+                throw std::runtime_error("Unable to read input file");
+            }
+        }
+    }
+
+    /* Wait for at least one completion and account for all that are ready.
+       Returns false if waiting failed. */
+    bool wait_for_completions()
+    {
+        if (::syscall(__NR_io_uring_enter, ring_.fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+            return false;
+        unsigned head{ *ring_.cq_head };
+        const unsigned tail{ __atomic_load_n(ring_.cq_tail, __ATOMIC_ACQUIRE) };
+        for (; head != tail; head++)
+        {
+            const io_uring_cqe& cqe{ ring_.cqes[head & *ring_.cq_mask] };
+            Slot& slot{ slots_[static_cast<size_t>(cqe.user_data)] };
+            slot.in_flight = false;
+            if (cqe.res > 0)
+                slot.filled += static_cast<size_t>(cqe.res);
+            else if (cqe.res == 0)
+                slot.length = slot.filled;
+            else if (cqe.res != -EINTR && cqe.res != -EAGAIN)
+                failed_ = true;
+            /* A short read that did not reach the end of the file (or an
+               interrupted one) continues where it stopped. */
+            if (!failed_ && slot.filled < slot.length)
+                resubmit_.push_back(&slot);
+        }
+        __atomic_store_n(ring_.cq_head, head, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    std::string_view next_async()
+    {
+        if (delivered_ != nullptr)
+        {
+            submit_block(*delivered_);
+            delivered_ = nullptr;
+        }
+
+        /* Blocks are submitted round-robin, so the next block in file order
+           is always in the slot after the one handed out last. */
+        Slot& slot{ slots_[next_slot_] };
+        while (slot.in_flight || slot.filled < slot.length)
+        {
+            if (!wait_for_completions() || failed_)
+                throw std::runtime_error("Unable to read input file");
+            for (Slot* pending : resubmit_)
+                submit_read(*pending);
+            resubmit_.clear();
+        }
+        next_slot_ = (next_slot_ + 1) % slots_.size();
+        delivered_ = &slot;
+        return std::string_view{ slot.buffer.data(), slot.filled };
+    }
+
+    IoUring ring_{};
+    Slot* delivered_{ nullptr };
+    size_t next_slot_{ 0 };
+    std::vector<Slot*> resubmit_{};
+    bool failed_{ false };
+#endif
+
+    std::vector<Slot> slots_{};
+#ifdef _WIN32
+    std::ifstream input_{};
+#else
+    int fd_{ -1 };
+    std::uint64_t size_{ 0 };
+    std::uint64_t next_offset_{ 0 };
+#endif
+};
+
+/* read_sailing_blocks(input_filename, sink, report)
+   Load input_filename with an AsyncBlockReader, parsing each block while
+   the following ones are read. Complete lines are parsed straight from the
+   block buffers; only a line split between two blocks is copied. Prints
+   the same messages as read_sailings. */
+template <typename Sink>
+void read_sailing_blocks(std::string const& input_filename, Sink& sink, LoadReport const& report)
+{
+    AsyncBlockReader reader{ input_filename };
+    LoadCounts counts{};
+    std::string carried{};
+    std::string_view block{ reader.next() };
+    while (!block.empty())
+    {
+        const size_t last_newline{ block.rfind('\n') };
+        if (last_newline == std::string_view::npos)
+        {
+            carried.append(block);
+            block = reader.next();
+            continue;
+        }
+
+        size_t start{ 0 };
+        if (!carried.empty())
+        {
+            start = block.find('\n') + 1;
+            carried.append(block.substr(0, start));
+            add_load_counts(counts, load_sailing_text(carried, counts.total_lines + 1, sink, report), report.samples);
+            carried.clear();
+        }
+        add_load_counts(counts, load_sailing_text(block.substr(start, last_newline + 1 - start), counts.total_lines + 1, sink, report), report.samples);
+        carried.assign(block.substr(last_newline + 1));
+        block = reader.next();
+    }
+    /* As with std::getline, a last line without a newline still counts. */
+    if (!carried.empty())
+        add_load_counts(counts, load_sailing_text(carried, counts.total_lines + 1, sink, report), report.samples);
+    print_load_summary(counts, report);
+}
+
+/* StreamingAggregate
+   A sink that folds every sailing straight into route and day totals and
+   keeps nothing else, so its size depends only on the number of distinct
+   routes and days. */
+struct StreamingAggregate
+{
+    RouteAggregate routes{};
+    DayAggregate days{};
+};
+
+void append_sailing(StreamingAggregate& aggregate, const SailingView& view)
+{
+    const bool late{ is_late_sailing(view.expected_duration, view.actual_duration) };
+    add_route_sailing(aggregate.routes, view.route_number, late);
+    add_day_sailing(aggregate.days, view.departure_date, late);
+}
+
+void reserve_sailings(StreamingAggregate&, size_t)
+{
+}
+
+std::vector<RouteStatistics> performance_by_route(StreamingAggregate const& aggregate)
+{
+    return aggregate.routes.routes;
+}
+
+DayAggregate aggregate_days(StreamingAggregate const& aggregate)
+{
+    return aggregate.days;
+}
+
+/* aggregate_sailing_stream(input_filename, report)
+   Read input_filename (or standard input, if the name is "-") in blocks and
+   fold it into a StreamingAggregate without storing any sailings. The
+   messages written to report are the same as read_sailings prints. */
+StreamingAggregate aggregate_sailing_stream(std::string const& input_filename, LoadReport const& report)
+{
+    StreamingAggregate aggregate{};
+    stream_sailings_into(input_filename, aggregate, report);
+    return aggregate;
+}
+
+/* Read input_filename (or standard input, if the name is "-") in blocks
+   with read_sailing_chunks, appending every valid sailing to sink, and
+   print the load summary. */
+template <typename Sink>
+void stream_sailings_into(std::string const& input_filename, Sink& sink, LoadReport const& report)
+{
+    LoadCounts counts{};
+    if (input_filename == "-")
+    {
+        counts = read_sailing_chunks(std::cin, sink, report);
+    }
+    else
+    {
+        std::ifstream input_file{ input_filename, std::ios::binary };
+        if (!input_file.is_open())
+            throw std::runtime_error("Unable to open input file");
+        counts = read_sailing_chunks(input_file, sink, report);
+    }
+    print_load_summary(counts, report);
+}
+
+/* Storage back ends for the loaders: append one parsed line, and reserve
+   room for an expected number of sailings. */
+void append_sailing(std::vector<Sailing>& sailings, const SailingView& view)
+{
+    sailings.push_back(to_sailing(view));
+}
+
+void reserve_sailings(std::vector<Sailing>& sailings, size_t count)
+{
+    sailings.reserve(count);
+}
+
+void append_sailings(std::vector<Sailing>& sailings, std::vector<Sailing>&& more)
+{
+    if (sailings.empty())
+        sailings = std::move(more);
+    else
+        sailings.insert(sailings.end(), std::make_move_iterator(more.begin()), std::make_move_iterator(more.end()));
+}
+
+/* Return the id of name in dictionary, adding it if it is new. */
+std::uint32_t intern_name(NameDictionary& dictionary, std::string_view name)
+{
+    const auto found{ dictionary.ids.find(name) };
+    if (found != dictionary.ids.end())
+        return found->second;
+
+    const std::uint32_t id{ static_cast<std::uint32_t>(dictionary.names.size()) };
+    dictionary.names.emplace_back(name);
+    dictionary.ids.emplace(dictionary.names.back(), id);
+    return id;
+}
+
+void append_sailing(SailingTable& table, const SailingView& view)
+{
+    table.route_number.push_back(view.route_number);
+    table.source_terminal.push_back(intern_name(table.terminals, view.source_terminal));
+    table.dest_terminal.push_back(intern_name(table.terminals, view.dest_terminal));
+    table.vessel.push_back(intern_name(table.vessels, view.vessel_name));
+    table.year.push_back(view.departure_date.year);
+    table.month.push_back(view.departure_date.month);
+    table.day.push_back(view.departure_date.day);
+    table.hour.push_back(static_cast<std::uint8_t>(view.scheduled_departure_time.hour));
+    table.minute.push_back(static_cast<std::uint8_t>(view.scheduled_departure_time.minute));
+    table.expected_duration.push_back(view.expected_duration);
+    table.actual_duration.push_back(view.actual_duration);
+}
+
+/* Append all sailings of more to table. The ids in more refer to its own
+   dictionaries, so they are translated into table's as they are copied. */
+void append_sailings(SailingTable& table, SailingTable&& more)
+{
+    if (table_size(table) == 0 && table.terminals.names.empty() && table.vessels.names.empty())
+    {
+        table = std::move(more);
+        return;
+    }
+
+    std::vector<std::uint32_t> terminal_ids{};
+    for (const std::string& name : more.terminals.names)
+        terminal_ids.push_back(intern_name(table.terminals, name));
+    std::vector<std::uint32_t> vessel_ids{};
+    for (const std::string& name : more.vessels.names)
+        vessel_ids.push_back(intern_name(table.vessels, name));
+
+    reserve_sailings(table, table_size(table) + table_size(more));
+    for (size_t i{ 0 }; i < table_size(more); i++)
+    {
+        table.source_terminal.push_back(terminal_ids[more.source_terminal[i]]);
+        table.dest_terminal.push_back(terminal_ids[more.dest_terminal[i]]);
+        table.vessel.push_back(vessel_ids[more.vessel[i]]);
+    }
+    table.route_number.insert(table.route_number.end(), more.route_number.begin(), more.route_number.end());
+    table.year.insert(table.year.end(), more.year.begin(), more.year.end());
+    table.month.insert(table.month.end(), more.month.begin(), more.month.end());
+    table.day.insert(table.day.end(), more.day.begin(), more.day.end());
+    table.hour.insert(table.hour.end(), more.hour.begin(), more.hour.end());
+    table.minute.insert(table.minute.end(), more.minute.begin(), more.minute.end());
+    table.expected_duration.insert(table.expected_duration.end(), more.expected_duration.begin(), more.expected_duration.end());
+    table.actual_duration.insert(table.actual_duration.end(), more.actual_duration.begin(), more.actual_duration.end());
+}
+
+void reserve_sailings(SailingTable& table, size_t count)
+{
+    table.route_number.reserve(count);
+    table.source_terminal.reserve(count);
+    table.dest_terminal.reserve(count);
+    table.vessel.reserve(count);
+    table.year.reserve(count);
+    table.month.reserve(count);
+    table.day.reserve(count);
+    table.hour.reserve(count);
+    table.minute.reserve(count);
+    table.expected_duration.reserve(count);
+    table.actual_duration.reserve(count);
+}
+
+size_t table_size(const SailingTable& table)
+{
+    return table.route_number.size();
+}
+
+size_t sailing_count(std::vector<Sailing> const& sailings)
+{
+    return sailings.size();
+}
+
+size_t sailing_count(SailingTable const& table)
+{
+    return table_size(table);
+}
+
+/* Convert between the two storage layouts. */
+SailingTable make_sailing_table(std::vector<Sailing> const& sailings)
+{
+    SailingTable table{};
+    reserve_sailings(table, sailings.size());
+    for (const Sailing& sailing : sailings)
+    {
+        SailingView view{ sailing.route_number, sailing.source_terminal, sailing.dest_terminal, sailing.vessel_name,
+                          sailing.departure_date, sailing.scheduled_departure_time,
+                          sailing.expected_duration, sailing.actual_duration };
+        append_sailing(table, view);
+    }
+    return table;
+}
+
+Sailing sailing_at(const SailingTable& table, size_t i)
+{
+    Sailing S{};
+    S.route_number = table.route_number[i];
+    S.source_terminal = table.terminals.names[table.source_terminal[i]];
+    S.dest_terminal = table.terminals.names[table.dest_terminal[i]];
+    S.vessel_name = table.vessels.names[table.vessel[i]];
+    S.departure_date = Date{ table.day[i], table.month[i], table.year[i] };
+    S.scheduled_departure_time = TimeOfDay{ table.hour[i], table.minute[i] };
+    S.expected_duration = table.expected_duration[i];
+    S.actual_duration = table.actual_duration[i];
+    return S;
+}
+
+/* Snapshot files
+   A snapshot is a binary copy of the SailingTable loaded from an input file,
+   written beside it as input_filename + ".snap". Later runs map the snapshot
+   and copy the columns out instead of parsing the text again. Layout:
+
+     SnapshotHeader
+     terminal names, then vessel names: uint32 length + bytes each
+     the load report (the exact text the parser printed)
+     the columns of SailingTable, in declaration order, as raw arrays
+
+   All values are in the byte order of the machine that wrote the file. The
+   snapshot is ignored (and rewritten) if its magic, version or byte order
+   differ, or if the size or modification time recorded for the source file
+   no longer match, or if it holds the load report in another --errors
+   style. Bump snapshot_version whenever the layout changes. */
+const char snapshot_magic[8]{ 'S', 'A', 'I', 'L', 'S', 'N', 'A', 'P' };
+const std::uint32_t snapshot_version{ 2 };
+const std::uint32_t snapshot_byte_order{ 0x01020304 };
+
+struct SnapshotHeader
+{
+    char magic[8]{};
+    std::uint32_t version{ 0 };
+    std::uint32_t byte_order{ 0 };
+    std::uint64_t source_size{ 0 };
+    std::int64_t source_mtime{ 0 };
+    std::uint64_t record_count{ 0 };
+    std::uint64_t terminal_count{ 0 };
+    std::uint64_t vessel_count{ 0 };
+    std::uint64_t report_size{ 0 };
+    std::uint64_t report_style{ 0 };
+};
+static_assert(sizeof(SnapshotHeader) == 72, "SnapshotHeader must not contain padding");
+
+/* The size and modification time of a source file, used to detect stale
+   snapshots. */
+struct SourceStamp
+{
+    std::uint64_t size{ 0 };
+    std::int64_t mtime{ 0 };
+};
+
+SourceStamp source_stamp(std::string const& input_filename)
+{
+    std::error_code error{};
+    const auto size{ std::filesystem::file_size(input_filename, error) };
+    if (error)
+        throw std::runtime_error("Unable to open input file");
+    const auto mtime{ std::filesystem::last_write_time(input_filename, error) };
+    if (error)
+        throw std::runtime_error("Unable to open input file");
+    return SourceStamp{ static_cast<std::uint64_t>(size), static_cast<std::int64_t>(mtime.time_since_epoch().count()) };
+}
+
+std::string snapshot_filename(std::string const& input_filename)
+{
+    return input_filename + ".snap";
+}
+
+/* A temporary name beside filename for a file that is written and then
+   renamed over it. The random suffix keeps two processes writing the same
+   file from writing into, or renaming, each other's temporary file. */
+std::string temporary_filename_for(std::string const& filename)
+{
+    std::random_device random{};
+    const std::uint64_t suffix{ (static_cast<std::uint64_t>(random()) << 32) ^ random() };
+    std::ostringstream name{};
+    name << filename << ".tmp-" << std::hex << suffix;
+    return name.str();
+}
+
+/* Rename temporary_filename over filename. Returns false, after removing
+   temporary_filename, if that fails. */
+bool rename_into_place(std::string const& temporary_filename, std::string const& filename)
+{
+    std::error_code error{};
+    std::filesystem::rename(temporary_filename, filename, error);
+    if (!error)
+        return true;
+    std::filesystem::remove(temporary_filename, error);
+    return false;
+}
+
+/* How a load report was written, recorded in SnapshotHeader::report_style:
+   0 for a message per invalid line, otherwise the sample limit + 1. */
+std::uint64_t report_style(LoadReport const& report)
+{
+    return report.summarize ? report.samples + 1 : 0;
+}
+
+/* Sequential reader over a mapped binary file. Every read checks the remaining
+   length; once a read fails, ok is false and all further reads fail. */
+struct BinaryReader
+{
+    std::string_view data{};
+    size_t position{ 0 };
+    bool ok{ true };
+};
+
+bool read_binary(BinaryReader& reader, void* destination, size_t size)
+{
+    if (!reader.ok || reader.data.size() - reader.position < size)
+    {
+        reader.ok = false;
+        return false;
+    }
+    if (size > 0)
+        std::memcpy(destination, reader.data.data() + reader.position, size);
+    reader.position += size;
+    return true;
+}
+
+template <typename T>
+void read_binary_column(BinaryReader& reader, std::vector<T>& column, size_t count)
+{
+    if (!reader.ok || (reader.data.size() - reader.position) / sizeof(T) < count)
+    {
+        reader.ok = false;
+        return;
+    }
+    column.resize(count);
+    read_binary(reader, column.data(), count * sizeof(T));
+}
+
+void read_snapshot_names(BinaryReader& reader, NameDictionary& dictionary, std::uint64_t count)
+{
+    for (std::uint64_t i{ 0 }; i < count && reader.ok; i++)
+    {
+        std::uint32_t length{ 0 };
+        if (!read_binary(reader, &length, sizeof(length)) || reader.data.size() - reader.position < length)
+        {
+            reader.ok = false;
+            return;
+        }
+        intern_name(dictionary, reader.data.substr(reader.position, length));
+        reader.position += length;
+    }
+}
+
+/* True if every id in column names an entry of dictionary. */
+bool ids_in_range(std::vector<std::uint32_t> const& column, NameDictionary const& dictionary)
+{
+    const size_t name_count{ dictionary.names.size() };
+    return std::all_of(column.begin(), column.end(), [name_count](std::uint32_t id) { return id < name_count; });
+}
+
+/* True if every departure time in table is a valid time of day. */
+bool times_in_range(SailingTable const& table)
+{
+    for (size_t i{ 0 }; i < table_size(table); i++)
+        if (!is_valid_time(table.hour[i], table.minute[i]))
+            return false;
+    return true;
+}
+
+/* load_snapshot(filename, stamp, style, table, report)
+   Fill table and report from the snapshot in filename. Returns false, with
+   table unspecified, if there is no usable snapshot for a source file with
+   the given stamp and a report in the given style. A snapshot whose name
+   ids or departure times are out of range counts as unusable too. */
+bool load_snapshot(std::string const& filename, SourceStamp const& stamp, std::uint64_t style, SailingTable& table, std::string& report)
+{
+    std::error_code error{};
+    if (!std::filesystem::is_regular_file(filename, error))
+        return false;
+
+    const MappedFile snapshot{ filename };
+    BinaryReader reader{ snapshot.contents() };
+
+    SnapshotHeader header{};
+    if (!read_binary(reader, &header, sizeof(header))
+        || std::memcmp(header.magic, snapshot_magic, sizeof(snapshot_magic)) != 0
+        || header.version != snapshot_version
+        || header.byte_order != snapshot_byte_order
+        || header.source_size != stamp.size
+        || header.source_mtime != stamp.mtime
+        || header.report_style != style)
+        return false;
+
+    read_snapshot_names(reader, table.terminals, header.terminal_count);
+    read_snapshot_names(reader, table.vessels, header.vessel_count);
+
+    if (!reader.ok || reader.data.size() - reader.position < header.report_size)
+        return false;
+    report.assign(reader.data.substr(reader.position, header.report_size));
+    reader.position += header.report_size;
+
+    const size_t count{ static_cast<size_t>(header.record_count) };
+    read_binary_column(reader, table.route_number, count);
+    read_binary_column(reader, table.source_terminal, count);
+    read_binary_column(reader, table.dest_terminal, count);
+    read_binary_column(reader, table.vessel, count);
+    read_binary_column(reader, table.year, count);
+    read_binary_column(reader, table.month, count);
+    read_binary_column(reader, table.day, count);
+    read_binary_column(reader, table.hour, count);
+    read_binary_column(reader, table.minute, count);
+    read_binary_column(reader, table.expected_duration, count);
+    read_binary_column(reader, table.actual_duration, count);
+    return reader.ok && reader.position == reader.data.size()
+        && ids_in_range(table.source_terminal, table.terminals)
+        && ids_in_range(table.dest_terminal, table.terminals)
+        && ids_in_range(table.vessel, table.vessels)
+        && times_in_range(table);
+}
+
+template <typename T>
+void write_binary_column(std::ofstream& output, std::vector<T> const& column)
+{
+    output.write(reinterpret_cast<const char*>(column.data()), static_cast<std::streamsize>(column.size() * sizeof(T)));
+}
+
+void write_snapshot_names(std::ofstream& output, NameDictionary const& dictionary)
+{
+    for (const std::string& name : dictionary.names)
+    {
+        const std::uint32_t length{ static_cast<std::uint32_t>(name.size()) };
+        output.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        output.write(name.data(), static_cast<std::streamsize>(name.size()));
+    }
+}
+
+/* write_snapshot(filename, stamp, style, table, report)
+   Save table and report (written in the given style) to filename. The file is written under a temporary
+   name and renamed into place, so readers never see a partial snapshot.
+   Returns false if the snapshot could not be written. */
+bool write_snapshot(std::string const& filename, SourceStamp const& stamp, std::uint64_t style, SailingTable const& table, std::string const& report)
+{
+    const std::string temporary_filename{ temporary_filename_for(filename) };
+    {
+        std::ofstream output{ temporary_filename, std::ios::binary | std::ios::trunc };
+        if (!output.is_open())
+            return false;
+
+        SnapshotHeader header{};
+        std::memcpy(header.magic, snapshot_magic, sizeof(snapshot_magic));
+        header.version = snapshot_version;
+        header.byte_order = snapshot_byte_order;
+        header.source_size = stamp.size;
+        header.source_mtime = stamp.mtime;
+        header.record_count = table_size(table);
+        header.terminal_count = table.terminals.names.size();
+        header.vessel_count = table.vessels.names.size();
+        header.report_size = report.size();
+        header.report_style = style;
+        output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        write_snapshot_names(output, table.terminals);
+        write_snapshot_names(output, table.vessels);
+        output.write(report.data(), static_cast<std::streamsize>(report.size()));
+
+        write_binary_column(output, table.route_number);
+        write_binary_column(output, table.source_terminal);
+        write_binary_column(output, table.dest_terminal);
+        write_binary_column(output, table.vessel);
+        write_binary_column(output, table.year);
+        write_binary_column(output, table.month);
+        write_binary_column(output, table.day);
+        write_binary_column(output, table.hour);
+        write_binary_column(output, table.minute);
+        write_binary_column(output, table.expected_duration);
+        write_binary_column(output, table.actual_duration);
+
+        if (!output.good())
+        {
+            output.close();
+            std::filesystem::remove(temporary_filename);
+            return false;
+        }
+    }
+
+    return rename_into_place(temporary_filename, filename);
+}
+
+/* read_sailing_table_cached(input_filename, loader, report)
+   Same result and messages as read_sailing_table, but the table is taken
+   from the snapshot beside input_filename when that snapshot is current.
+   Otherwise the text is parsed and a new snapshot is written. */
+SailingTable read_sailing_table_cached(std::string const& input_filename, LoaderKind loader, LoadReport const& load_report)
+{
+    const SourceStamp stamp{ source_stamp(input_filename) };
+    const std::string cache_filename{ snapshot_filename(input_filename) };
+    const std::uint64_t style{ report_style(load_report) };
+
+    {
+        SailingTable cached{};
+        std::string report{};
+        if (load_snapshot(cache_filename, stamp, style, cached, report))
+        {
+            load_report.stream << report;
+            return cached;
+        }
+    }
+
+    std::ostringstream report{};
+    SailingTable table{ read_sailing_table(input_filename, loader, LoadReport{ report, load_report.summarize, load_report.samples }) };
+    load_report.stream << report.str();
+    if (!write_snapshot(cache_filename, stamp, style, table, report.str()))
+        std::cerr << "Unable to write snapshot " << cache_filename << std::endl;
+    return table;
+}
+
+/* Expand a table back into Sailing records, for the row storage mode. */
+std::vector<Sailing> table_to_sailings(const SailingTable& table)
+{
+    std::vector<Sailing> sailings{};
+    sailings.reserve(table_size(table));
+    for (size_t i{ 0 }; i < table_size(table); i++)
+        sailings.push_back(sailing_at(table, i));
+    return sailings;
+}
+
+/* Multi-file input
+   input_filename may name a directory (every .txt file in it) or a
+   pattern with * and ? in its last component (data/0?_*.txt). The files
+   are loaded concurrently, each into its own SailingTable with its own
+   messages, and then merged in name order. Extracts of the same archive
+   overlap, so a sailing whose route, terminals, date, departure time and
+   vessel already came from an earlier file is dropped. Sailings are
+   never dropped because of other lines in the same file, so a single file
+   gives the same result as before. */
+
+/* True if input_filename names a directory or a file pattern rather than
+   one file. */
+bool is_multi_file_input(std::string const& input_filename)
+{
+    std::error_code error{};
+    return input_filename.find_first_of("*?") != std::string::npos || std::filesystem::is_directory(input_filename, error);
+}
+
+/* Match name against pattern, where * matches any run of characters and ?
+   matches any one character. */
+bool matches_pattern(std::string_view name, std::string_view pattern)
+{
+    size_t n{ 0 };
+    size_t p{ 0 };
+    size_t star{ std::string_view::npos };
+    size_t star_name{ 0 };
+    while (n < name.size())
+    {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n]))
+        {
+            n++;
+            p++;
+        }
+        else if (p < pattern.size() && pattern[p] == '*')
+        {
+            star = p++;
+            star_name = n;
+        }
+        else if (star != std::string_view::npos)
+        {
+            p = star + 1;
+            n = ++star_name;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*')
+        p++;
+    return p == pattern.size();
+}
+
+/* The regular files input_filename refers to, sorted by name. */
+std::vector<std::string> expand_input_files(std::string const& input_filename)
+{
+    std::filesystem::path directory{ input_filename };
+    std::string pattern{ "*.txt" };
+    std::error_code error{};
+    if (!std::filesystem::is_directory(directory, error))
+    {
+        pattern = directory.filename().string();
+        directory = directory.parent_path();
+        if (directory.empty())
+            directory = ".";
+    }
+
+    std::vector<std::string> files{};
+    for (const auto& entry : std::filesystem::directory_iterator{ directory, error })
+    {
+        if (entry.is_regular_file(error) && matches_pattern(entry.path().filename().string(), pattern))
+            files.push_back(entry.path().string());
+    }
+    if (error)
+        throw std::runtime_error("Unable to read input directory");
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+/* The fields that identify a sailing for de-duplication, with names as ids
+   in the merged table's dictionaries. */
+struct SailingKey
+{
+    int route_number{ 0 };
+    std::uint32_t source_terminal{ 0 };
+    std::uint32_t dest_terminal{ 0 };
+    std::uint32_t vessel{ 0 };
+    std::uint64_t date{ 0 };
+    std::uint32_t time{ 0 };
+};
+
+struct SailingKeyHash
+{
+    size_t operator()(const SailingKey& key) const
+    {
+        std::uint64_t hash{ 1469598103934665603ULL };
+        const std::uint64_t parts[]{ static_cast<std::uint32_t>(key.route_number), key.source_terminal, key.dest_terminal, key.vessel, key.date, key.time };
+        for (std::uint64_t part : parts)
+        {
+            hash ^= part;
+            hash *= 1099511628211ULL;
+            hash ^= hash >> 29;
+        }
+        return static_cast<size_t>(hash);
+    }
+};
+
+struct SailingKeyEqual
+{
+    bool operator()(const SailingKey& key1, const SailingKey& key2) const
+    {
+        return key1.route_number == key2.route_number && key1.source_terminal == key2.source_terminal
+            && key1.dest_terminal == key2.dest_terminal && key1.vessel == key2.vessel
+            && key1.date == key2.date && key1.time == key2.time;
+    }
+};
+
+/* read_sailing_files(input_filename, loader, report)
+   Load every file input_filename refers to (see expand_input_files) into
+   one SailingTable, dropping sailings already read from an earlier file.
+   For each file its name is written to report, followed by the messages
+   read_sailing_table writes for it; the totals for all files come last. */
+SailingTable read_sailing_files(std::string const& input_filename, LoaderKind loader, LoadReport const& report)
+{
+    const std::vector<std::string> files{ expand_input_files(input_filename) };
+    if (files.empty())
+        throw std::runtime_error("No input files found");
+
+    /* Each file is already split across threads by the parallel loader, so
+       the files themselves are only read concurrently by the others. */
+    const LoaderKind file_loader{ loader == LoaderKind::Parallel ? LoaderKind::Mapped : loader };
+    std::vector<SailingTable> tables(files.size());
+    std::vector<std::string> messages(files.size());
+    std::vector<std::exception_ptr> failures(files.size());
+    const size_t workers{ std::max<size_t>(1, std::min<size_t>(files.size(), std::thread::hardware_concurrency())) };
+    run_workers(workers, [&](size_t w) {
+        for (size_t f{ w }; f < files.size(); f += workers)
+        {
+            try
+            {
+                std::ostringstream file_report{};
+                tables[f] = read_sailing_table(files[f], file_loader, LoadReport{ file_report, report.summarize, report.samples });
+                messages[f] = file_report.str();
+            }
+            catch (...)
+            {
+                failures[f] = std::current_exception();
+            }
+        }
+    });
+
+    SailingTable merged{};
+    std::unordered_set<SailingKey, SailingKeyHash, SailingKeyEqual> seen{};
+    std::vector<SailingKey> file_keys{};
+    size_t duplicates{ 0 };
+    for (size_t f{ 0 }; f < files.size(); f++)
+    {
+        if (failures[f])
+            std::rethrow_exception(failures[f]);
+        report.stream << "Reading " << files[f] << std::endl << messages[f];
+
+        const SailingTable& table{ tables[f] };
+        std::vector<std::uint32_t> terminal_ids{};
+        for (const std::string& name : table.terminals.names)
+            terminal_ids.push_back(intern_name(merged.terminals, name));
+        std::vector<std::uint32_t> vessel_ids{};
+        for (const std::string& name : table.vessels.names)
+            vessel_ids.push_back(intern_name(merged.vessels, name));
+
+        file_keys.clear();
+        for (size_t i{ 0 }; i < table_size(table); i++)
+        {
+            const SailingKey key{ table.route_number[i], terminal_ids[table.source_terminal[i]], terminal_ids[table.dest_terminal[i]],
+                                  vessel_ids[table.vessel[i]], pack_date(Date{ table.day[i], table.month[i], table.year[i] }),
+                                  static_cast<std::uint32_t>(table.hour[i]) * 60 + table.minute[i] };
+            if (seen.count(key) != 0)
+            {
+                duplicates++;
+                continue;
+            }
+            file_keys.push_back(key);
+            merged.route_number.push_back(table.route_number[i]);
+            merged.source_terminal.push_back(key.source_terminal);
+            merged.dest_terminal.push_back(key.dest_terminal);
+            merged.vessel.push_back(key.vessel);
+            merged.year.push_back(table.year[i]);
+            merged.month.push_back(table.month[i]);
+            merged.day.push_back(table.day[i]);
+            merged.hour.push_back(table.hour[i]);
+            merged.minute.push_back(table.minute[i]);
+            merged.expected_duration.push_back(table.expected_duration[i]);
+            merged.actual_duration.push_back(table.actual_duration[i]);
+        }
+        seen.insert(file_keys.begin(), file_keys.end());
+        tables[f] = SailingTable{};
+    }
+
+    report.stream << "Read " << table_size(merged) << " records from " << files.size() << " files." << std::endl;
+    report.stream << "Dropped " << duplicates << " duplicate records." << std::endl;
+    return merged;
+}
+
+/* Report output
+   Reports are formatted into one reusable buffer and handed to the output
+   stream in large writes instead of one operator<< per field and a flush
+   per line. Integers are formatted with std::to_chars. The same rows can
+   be written as the original text, as CSV (with a header line) or as JSON
+   Lines (one object per row). */
+
+/* ReportWriter
+   Appends formatted text to a buffer and writes it to output whenever the
+   buffer passes flush_threshold bytes, and when the writer is destroyed. */
+class ReportWriter
+{
+public:
+    explicit ReportWriter(std::ostream& output) : output_{ output }
+    {
+        buffer_.reserve(flush_threshold + 4096);
+    }
+
+    ~ReportWriter()
+    {
+        flush();
+    }
+
+    ReportWriter(ReportWriter const&) = delete;
+    ReportWriter& operator=(ReportWriter const&) = delete;
+
+    ReportWriter& text(std::string_view text)
+    {
+        buffer_.append(text.data(), text.size());
+        return *this;
+    }
+
+    ReportWriter& integer(long long value)
+    {
+        char digits[24]{};
+        const auto result{ std::to_chars(digits, digits + sizeof(digits), value) };
+        buffer_.append(digits, result.ptr);
+        return *this;
+    }
+
+    /* value with leading zeros to at least width digits (like
+       std::setfill('0') << std::setw(width)). */
+    ReportWriter& padded(int value, int width)
+    {
+        char digits[24]{};
+        const auto result{ std::to_chars(digits, digits + sizeof(digits), value) };
+        const int length{ static_cast<int>(result.ptr - digits) };
+        buffer_.append(static_cast<size_t>(std::max(0, width - length)), '0');
+        buffer_.append(digits, result.ptr);
+        return *this;
+    }
+
+    /* value with exactly precision digits after the decimal point. */
+    ReportWriter& fixed(double value, int precision)
+    {
+        char digits[64]{};
+        const auto result{ std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::fixed, precision) };
+        buffer_.append(digits, result.ptr);
+        return *this;
+    }
+
+    /* A CSV field, quoted if it holds a comma, a quote or a line break. */
+    ReportWriter& csv_field(std::string_view field)
+    {
+        if (field.find_first_of(",\"\r\n") == std::string_view::npos)
+            return text(field);
+        buffer_.push_back('"');
+        for (char c : field)
+        {
+            if (c == '"')
+                buffer_.push_back('"');
+            buffer_.push_back(c);
+        }
+        buffer_.push_back('"');
+        return *this;
+    }
+
+    /* A JSON string literal, with the characters JSON requires escaped. */
+    ReportWriter& json_string(std::string_view field)
+    {
+        const char hex[]{ "0123456789abcdef" };
+        buffer_.push_back('"');
+        for (char c : field)
+        {
+            const unsigned char byte{ static_cast<unsigned char>(c) };
+            if (c == '"' || c == '\\')
+            {
+                buffer_.push_back('\\');
+                buffer_.push_back(c);
+            }
+            else if (byte < 0x20)
+            {
+                buffer_.append("\\u00");
+                buffer_.push_back(hex[byte >> 4]);
+                buffer_.push_back(hex[byte & 0xF]);
+            }
+            else
+            {
+                buffer_.push_back(c);
+            }
+        }
+        buffer_.push_back('"');
+        return *this;
+    }
+
+    void end_line()
+    {
+        buffer_.push_back('\n');
+        if (buffer_.size() >= flush_threshold)
+            flush();
+    }
+
+    void flush()
+    {
+        if (!buffer_.empty())
+        {
+            output_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+            buffer_.clear();
+        }
+        output_.flush();
+    }
+
+private:
+    static constexpr size_t flush_threshold{ 1 << 16 };
+
+    std::ostream& output_;
+    std::string buffer_{};
+};
+
+/* Write a heading line such as "Best days:". Headings only appear in text
+   output; CSV and JSON Lines output contain nothing but rows. */
+void write_heading(ReportWriter& writer, ReportFormat format, std::string_view heading)
+{
+    if (format == ReportFormat::Text)
+    {
+        writer.text(heading);
+        writer.end_line();
+    }
+}
+
+/* The CSV header for route rows. list is true if the rows carry a "list"
+   column (best or worst). */
+void write_route_header(ReportWriter& writer, ReportFormat format, bool list)
+{
+    if (format == ReportFormat::Csv)
+    {
+        writer.text(list ? "list," : "").text("route,total_sailings,late_sailings");
+        writer.end_line();
+    }
+}
+
+/* Write one route row. list is the name of the list the row belongs to, or
+   empty if there is only one. */
+void write_route(ReportWriter& writer, ReportFormat format, std::string_view list, RouteStatistics const& stats)
+{
+    switch (format)
+    {
+    case ReportFormat::Text:
+        writer.text("Route ").integer(stats.route_number).text(": ").integer(stats.total_sailings);
+        writer.text(" sailings (").integer(stats.late_sailings).text(" late)");
+        break;
+    case ReportFormat::Csv:
+        if (!list.empty())
+            writer.text(list).text(",");
+        writer.integer(stats.route_number).text(",").integer(stats.total_sailings).text(",").integer(stats.late_sailings);
+        break;
+    case ReportFormat::JsonLines:
+        writer.text("{");
+        if (!list.empty())
+            writer.text("\"list\":").json_string(list).text(",");
+        writer.text("\"route\":").integer(stats.route_number).text(",\"total_sailings\":").integer(stats.total_sailings);
+        writer.text(",\"late_sailings\":").integer(stats.late_sailings).text("}");
+        break;
+    }
+    writer.end_line();
+}
+
+void write_day_header(ReportWriter& writer, ReportFormat format)
+{
+    if (format == ReportFormat::Csv)
+    {
+        writer.text("list,year,month,day,total_sailings,late_sailings");
+        writer.end_line();
+    }
+}
+
+/* Write one day row; list is "best" or "worst". */
+void write_day(ReportWriter& writer, ReportFormat format, std::string_view list, DayStatistics const& stats)
+{
+    switch (format)
+    {
+    case ReportFormat::Text:
+        writer.integer(stats.date.year).text("-").integer(stats.date.month).text("-").integer(stats.date.day).text(": ");
+        writer.integer(stats.total_sailings).text(" sailings (").integer(stats.late_sailings).text(" late)");
+        break;
+    case ReportFormat::Csv:
+        writer.text(list).text(",").integer(stats.date.year).text(",").integer(stats.date.month).text(",").integer(stats.date.day);
+        writer.text(",").integer(stats.total_sailings).text(",").integer(stats.late_sailings);
+        break;
+    case ReportFormat::JsonLines:
+        writer.text("{\"list\":").json_string(list).text(",\"year\":").integer(stats.date.year);
+        writer.text(",\"month\":").integer(stats.date.month).text(",\"day\":").integer(stats.date.day);
+        writer.text(",\"total_sailings\":").integer(stats.total_sailings).text(",\"late_sailings\":").integer(stats.late_sailings).text("}");
+        break;
+    }
+    writer.end_line();
+}
+
+void write_sailing_header(ReportWriter& writer, ReportFormat format)
+{
+    if (format == ReportFormat::Csv)
+    {
+        writer.text("route,source_terminal,dest_terminal,vessel,year,month,day,hour,minute,expected_duration,actual_duration");
+        writer.end_line();
+    }
+}
+
+/* Write one sailing. The text form is the one print_sailing uses. */
+void write_sailing(ReportWriter& writer, ReportFormat format, SailingView const& sailing)
+{
+    const Date& date{ sailing.departure_date };
+    const TimeOfDay& time{ sailing.scheduled_departure_time };
+    switch (format)
+    {
+    case ReportFormat::Text:
+        writer.text("Route ").integer(sailing.route_number);
+        writer.text(" (").text(sailing.source_terminal).text(" -> ").text(sailing.dest_terminal).text("): ");
+        writer.integer(date.year).text("-").padded(date.month, 2).text("-").padded(date.day, 2).text(" ");
+        writer.padded(time.hour, 2).text(":").padded(time.minute, 2).text(" ");
+        writer.text("[Vessel: ").text(sailing.vessel_name).text("] ");
+        writer.integer(sailing.actual_duration).text(" minutes (").integer(sailing.expected_duration).text(" expected)");
+        break;
+    case ReportFormat::Csv:
+        writer.integer(sailing.route_number).text(",").csv_field(sailing.source_terminal).text(",");
+        writer.csv_field(sailing.dest_terminal).text(",").csv_field(sailing.vessel_name).text(",");
+        writer.integer(date.year).text(",").integer(date.month).text(",").integer(date.day).text(",");
+        writer.integer(time.hour).text(",").integer(time.minute).text(",");
+        writer.integer(sailing.expected_duration).text(",").integer(sailing.actual_duration);
+        break;
+    case ReportFormat::JsonLines:
+        writer.text("{\"route\":").integer(sailing.route_number);
+        writer.text(",\"source_terminal\":").json_string(sailing.source_terminal);
+        writer.text(",\"dest_terminal\":").json_string(sailing.dest_terminal);
+        writer.text(",\"vessel\":").json_string(sailing.vessel_name);
+        writer.text(",\"year\":").integer(date.year).text(",\"month\":").integer(date.month).text(",\"day\":").integer(date.day);
+        writer.text(",\"hour\":").integer(time.hour).text(",\"minute\":").integer(time.minute);
+        writer.text(",\"expected_duration\":").integer(sailing.expected_duration);
+        writer.text(",\"actual_duration\":").integer(sailing.actual_duration).text("}");
+        break;
+    }
+    writer.end_line();
+}
+
+/* Write every stored sailing, in load order. */
+void write_sailings(ReportWriter& writer, ReportFormat format, std::vector<Sailing> const& sailings)
+{
+    write_sailing_header(writer, format);
+    for (const Sailing& sailing : sailings)
+    {
+        write_sailing(writer, format, SailingView{ sailing.route_number, sailing.source_terminal, sailing.dest_terminal, sailing.vessel_name,
+                                                   sailing.departure_date, sailing.scheduled_departure_time,
+                                                   sailing.expected_duration, sailing.actual_duration });
+    }
+}
+
+void write_sailings(ReportWriter& writer, ReportFormat format, SailingTable const& table)
+{
+    write_sailing_header(writer, format);
+    for (size_t i{ 0 }; i < table_size(table); i++)
+    {
+        write_sailing(writer, format, SailingView{ table.route_number[i], table.terminals.names[table.source_terminal[i]],
+                                                   table.terminals.names[table.dest_terminal[i]], table.vessels.names[table.vessel[i]],
+                                                   Date{ table.day[i], table.month[i], table.year[i] },
+                                                   TimeOfDay{ table.hour[i], table.minute[i] },
+                                                   table.expected_duration[i], table.actual_duration[i] });
+    }
+}
+
+void write_sailings(ReportWriter& writer, ReportFormat, StreamingAggregate const&)
+{
+    writer.text("The sailings action needs stored sailings; it is not available with --storage=none or --checkpoint.");
+    writer.end_line();
+}
+
+/* Group-by queries
+   group_sailings answers "count, late count, mean and max delay for every
+   combination of these keys" over a vector or a SailingTable in one
+   aggregation pass. One pass over the sailings gives every requested
+   dimension a code per sailing, in the order its values are first seen:
+   hours, months, weekdays and times of day find their code by offset into
+   a small array, and routes, years and names through a hash map. Only the
+   distinct values are then sorted, into label order (numerically, or by
+   name), and the ranked codes are combined column by column into one
+   mixed-radix key per sailing. The aggregation kernel then only sees that
+   key column and the two durations. When the key space is small the
+   accumulators are a dense array indexed by key; otherwise they live in a
+   hash table. Either way groups come out sorted by their labels. */
+
+/* Day of the week of date, 0 = Sunday ... 6 = Saturday, or 7 if it is not
+   a calendar date. */
+std::uint32_t weekday_of(const Date& date)
+{
+    if (!has_day_number(date))
+        return 7;
+    return static_cast<std::uint32_t>(((to_day_number(date) % 7) + 7 + 4) % 7);
+}
+
+/* The fields group_sailings reads from sailing i, for either layout. */
+int route_at(std::vector<Sailing> const& sailings, size_t i)
+{
+    return sailings[i].route_number;
+}
+
+int route_at(SailingTable const& table, size_t i)
+{
+    return table.route_number[i];
+}
+
+Date date_at(std::vector<Sailing> const& sailings, size_t i)
+{
+    return sailings[i].departure_date;
+}
+
+Date date_at(SailingTable const& table, size_t i)
+{
+    return Date{ table.day[i], table.month[i], table.year[i] };
+}
+
+TimeOfDay time_at(std::vector<Sailing> const& sailings, size_t i)
+{
+    return sailings[i].scheduled_departure_time;
+}
+
+TimeOfDay time_at(SailingTable const& table, size_t i)
+{
+    return TimeOfDay{ table.hour[i], table.minute[i] };
+}
+
+std::pair<int, int> durations_at(std::vector<Sailing> const& sailings, size_t i)
+{
+    return { sailings[i].expected_duration, sailings[i].actual_duration };
+}
+
+std::pair<int, int> durations_at(SailingTable const& table, size_t i)
+{
+    return { table.expected_duration[i], table.actual_duration[i] };
+}
+
+/* First-seen codes for one integer dimension. Values in [low, low + span)
+   find their code by offset; any others go through the hash map, which is
+   skipped while the same value repeats. values holds the value of each
+   code. */
+struct IntKeyCodes
+{
+    int low{ 0 };
+    std::vector<std::uint32_t> by_offset{};
+    std::unordered_map<int, std::uint32_t> by_value{};
+    std::vector<int> values{};
+    int last_value{ 0 };
+    std::uint32_t last_code{ UINT32_MAX };
+};
+
+std::uint32_t int_key_code(IntKeyCodes& keys, int value)
+{
+    if (keys.last_code != UINT32_MAX && value == keys.last_value)
+        return keys.last_code;
+    const long long offset{ static_cast<long long>(value) - keys.low };
+    std::uint32_t& code{ offset >= 0 && offset < static_cast<long long>(keys.by_offset.size())
+                             ? keys.by_offset[static_cast<size_t>(offset)]
+                             : keys.by_value.emplace(value, UINT32_MAX).first->second };
+    if (code == UINT32_MAX)
+    {
+        code = static_cast<std::uint32_t>(keys.values.size());
+        keys.values.push_back(value);
+    }
+    keys.last_value = value;
+    keys.last_code = code;
+    return code;
+}
+
+/* Codes and labels for one group-by dimension. codes holds each sailing's
+   first-seen code; names and days collect the distinct names (from a
+   vector) and dates. */
+struct GroupKeyEncoder
+{
+    GroupDimension dimension{ GroupDimension::Route };
+    IntKeyCodes ints{};
+    std::unordered_map<std::string_view, std::uint32_t> name_codes{};
+    std::vector<std::string_view> names{};
+    DayAggregate days{};
+    std::vector<std::uint32_t> codes{};
+};
+
+GroupKeyEncoder make_group_key_encoder(GroupDimension dimension, size_t count)
+{
+    GroupKeyEncoder encoder{};
+    encoder.dimension = dimension;
+    switch (dimension)
+    {
+    case GroupDimension::Month:
+        encoder.ints.low = 1;
+        encoder.ints.by_offset.assign(12, UINT32_MAX);
+        break;
+    case GroupDimension::Hour:
+        encoder.ints.by_offset.assign(24, UINT32_MAX);
+        break;
+    case GroupDimension::Weekday:
+        encoder.ints.by_offset.assign(8, UINT32_MAX);
+        break;
+    case GroupDimension::Time:
+        encoder.ints.by_offset.assign(24 * 60, UINT32_MAX);
+        break;
+    default:
+        break;
+    }
+    encoder.codes.resize(count);
+    return encoder;
+}
+
+/* Name codes: a table already numbers its names, a vector's are numbered
+   as they are first seen. */
+std::uint32_t name_key_code(GroupKeyEncoder& encoder, SailingTable const& table, size_t i)
+{
+    switch (encoder.dimension)
+    {
+    case GroupDimension::SourceTerminal:
+        return table.source_terminal[i];
+    case GroupDimension::DestTerminal:
+        return table.dest_terminal[i];
+    default:
+        return table.vessel[i];
+    }
+}
+
+std::uint32_t name_key_code(GroupKeyEncoder& encoder, std::vector<Sailing> const& sailings, size_t i)
+{
+    const Sailing& sailing{ sailings[i] };
+    const std::string& name{ encoder.dimension == GroupDimension::SourceTerminal ? sailing.source_terminal
+                             : encoder.dimension == GroupDimension::DestTerminal ? sailing.dest_terminal
+                                                                                 : sailing.vessel_name };
+    const auto inserted{ encoder.name_codes.emplace(name, static_cast<std::uint32_t>(encoder.names.size())) };
+    if (inserted.second)
+        encoder.names.push_back(name);
+    return inserted.first->second;
+}
+
+/* The first-seen code of sailing i for encoder's dimension. */
+template <typename Sailings>
+std::uint32_t group_key_code(GroupKeyEncoder& encoder, Sailings const& sailings, size_t i)
+{
+    switch (encoder.dimension)
+    {
+    case GroupDimension::Route:
+        return int_key_code(encoder.ints, route_at(sailings, i));
+    case GroupDimension::SourceTerminal:
+    case GroupDimension::DestTerminal:
+    case GroupDimension::Vessel:
+        return name_key_code(encoder, sailings, i);
+    case GroupDimension::Year:
+        return int_key_code(encoder.ints, date_at(sailings, i).year);
+    case GroupDimension::Month:
+        return int_key_code(encoder.ints, date_at(sailings, i).month);
+    case GroupDimension::Hour:
+        return int_key_code(encoder.ints, time_at(sailings, i).hour);
+    case GroupDimension::Weekday:
+        return int_key_code(encoder.ints, static_cast<int>(weekday_of(date_at(sailings, i))));
+    case GroupDimension::Date:
+        return static_cast<std::uint32_t>(&day_entry(encoder.days, date_at(sailings, i)) - encoder.days.days.data());
+    case GroupDimension::Time:
+        return int_key_code(encoder.ints, to_minute_of_day(time_at(sailings, i)));
+    }
+    return 0;
+}
+
+/* Positions of values in increasing order. */
+template <typename Values>
+std::vector<std::uint32_t> sorted_order(Values const& values)
+{
+    std::vector<std::uint32_t> order(values.size());
+    for (size_t i{ 0 }; i < order.size(); i++)
+        order[i] = static_cast<std::uint32_t>(i);
+    std::sort(order.begin(), order.end(), [&values](std::uint32_t a, std::uint32_t b) { return values[a] < values[b]; });
+    return order;
+}
+
+/* The HH:MM label of a minute of the day. */
+std::string time_label(int minute_of_day)
+{
+    const TimeOfDay time{ from_minute_of_day(static_cast<MinuteOfDay>(minute_of_day)) };
+    return std::string{ static_cast<char>('0' + time.hour / 10), static_cast<char>('0' + time.hour % 10), ':',
+                        static_cast<char>('0' + time.minute / 10), static_cast<char>('0' + time.minute % 10) };
+}
+
+/* The codes of the names in alphabetical order, with their labels. */
+std::vector<std::uint32_t> name_order(GroupKeyEncoder const& encoder, SailingTable const& table, std::vector<std::string>& labels)
+{
+    NameDictionary const& dictionary{ encoder.dimension == GroupDimension::Vessel ? table.vessels : table.terminals };
+    const std::vector<std::uint32_t> order{ sorted_order(dictionary.names) };
+    for (std::uint32_t code : order)
+        labels.push_back(dictionary.names[code]);
+    return order;
+}
+
+std::vector<std::uint32_t> name_order(GroupKeyEncoder const& encoder, std::vector<Sailing> const&, std::vector<std::string>& labels)
+{
+    const std::vector<std::uint32_t> order{ sorted_order(encoder.names) };
+    for (std::uint32_t code : order)
+        labels.push_back(std::string{ encoder.names[code] });
+    return order;
+}
+
+/* Fill labels (in label order) for the values encoder has seen and return
+   the label rank of each of its codes. */
+template <typename Sailings>
+std::vector<std::uint32_t> group_key_ranks(GroupKeyEncoder const& encoder, Sailings const& sailings, std::vector<std::string>& labels)
+{
+    const char* const weekday_names[]{ "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "?" };
+    std::vector<std::uint32_t> order{};
+    switch (encoder.dimension)
+    {
+    case GroupDimension::SourceTerminal:
+    case GroupDimension::DestTerminal:
+    case GroupDimension::Vessel:
+        order = name_order(encoder, sailings, labels);
+        break;
+    case GroupDimension::Date:
+        for (size_t code : chronological_order(encoder.days.days))
+        {
+            const Date& date{ encoder.days.days[code].date };
+            order.push_back(static_cast<std::uint32_t>(code));
+            labels.push_back(std::to_string(date.year) + "-" + std::to_string(date.month) + "-" + std::to_string(date.day));
+        }
+        break;
+    default:
+        order = sorted_order(encoder.ints.values);
+        for (std::uint32_t code : order)
+        {
+            const int value{ encoder.ints.values[code] };
+            labels.push_back(encoder.dimension == GroupDimension::Weekday ? std::string{ weekday_names[value] }
+                             : encoder.dimension == GroupDimension::Time  ? time_label(value)
+                                                                          : std::to_string(value));
+        }
+        break;
+    }
+
+    std::vector<std::uint32_t> rank(order.size());
+    for (size_t r{ 0 }; r < order.size(); r++)
+        rank[order[r]] = static_cast<std::uint32_t>(r);
+    return rank;
+}
+
+/* Running totals for one group. */
+struct GroupAccumulator
+{
+    int total_sailings{ 0 };
+    int late_sailings{ 0 };
+    long long total_delay{ 0 };
+    int max_delay{ INT_MIN };
+};
+
+void add_group_sailing(GroupAccumulator& group, int expected_duration, int actual_duration)
+{
+    const int delay{ actual_duration - expected_duration };
+    group.total_sailings++;
+    if (is_late_sailing(expected_duration, actual_duration))
+        group.late_sailings++;
+    group.total_delay += delay;
+    group.max_delay = std::max(group.max_delay, delay);
+}
+
+/* group_sailings(sailings, dimensions)
+   Return one GroupStatistics for every combination of dimension values that
+   occurs in sailings (a vector or a table), sorted by those values. With no
+   dimensions the result is a single group covering every sailing (if there
+   are any). */
+template <typename Sailings>
+std::vector<GroupStatistics> group_sailings(Sailings const& sailings, std::vector<GroupDimension> const& dimensions)
+{
+    const size_t count{ sailing_count(sailings) };
+    const size_t dense_group_limit{ 1 << 20 };
+
+    std::vector<GroupKeyEncoder> encoders{};
+    for (GroupDimension dimension : dimensions)
+        encoders.push_back(make_group_key_encoder(dimension, count));
+    for (size_t i{ 0 }; i < count; i++)
+        for (GroupKeyEncoder& encoder : encoders)
+            encoder.codes[i] = group_key_code(encoder, sailings, i);
+
+    /* Build the composite key column one dimension at a time. The last
+       dimension varies fastest, so key order is label order. */
+    std::vector<std::uint64_t> keys(count, 0);
+    std::vector<std::vector<std::string>> labels(dimensions.size());
+    std::vector<std::uint64_t> radix(dimensions.size(), 1);
+    std::uint64_t key_space{ 1 };
+    for (size_t d{ 0 }; d < dimensions.size(); d++)
+    {
+        const std::vector<std::uint32_t> rank{ group_key_ranks(encoders[d], sailings, labels[d]) };
+        radix[d] = std::max<std::uint64_t>(1, labels[d].size());
+        if (key_space > UINT64_MAX / radix[d])
+            throw std::runtime_error("Too many groups");
+        key_space *= radix[d];
+        const std::vector<std::uint32_t>& codes{ encoders[d].codes };
+        for (size_t i{ 0 }; i < count; i++)
+            keys[i] = keys[i] * radix[d] + rank[codes[i]];
+    }
+
+    std::vector<std::pair<std::uint64_t, GroupAccumulator>> groups{};
+    if (key_space <= dense_group_limit)
+    {
+        std::vector<GroupAccumulator> dense(static_cast<size_t>(key_space));
+        for (size_t i{ 0 }; i < count; i++)
+        {
+            const std::pair<int, int> durations{ durations_at(sailings, i) };
+            add_group_sailing(dense[static_cast<size_t>(keys[i])], durations.first, durations.second);
+        }
+        for (size_t key{ 0 }; key < dense.size(); key++)
+            if (dense[key].total_sailings > 0)
+                groups.emplace_back(key, dense[key]);
+    }
+    else
+    {
+        std::unordered_map<std::uint64_t, GroupAccumulator> sparse{};
+        for (size_t i{ 0 }; i < count; i++)
+        {
+            const std::pair<int, int> durations{ durations_at(sailings, i) };
+            add_group_sailing(sparse[keys[i]], durations.first, durations.second);
+        }
+        groups.assign(sparse.begin(), sparse.end());
+        std::sort(groups.begin(), groups.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    }
+
+    std::vector<GroupStatistics> result{};
+    for (const auto& group : groups)
+    {
+        GroupStatistics stats{};
+        stats.labels.resize(dimensions.size());
+        std::uint64_t key{ group.first };
+        for (size_t d{ dimensions.size() }; d-- > 0;)
+        {
+            stats.labels[d] = labels[d][static_cast<size_t>(key % radix[d])];
+            key /= radix[d];
+        }
+        stats.total_sailings = group.second.total_sailings;
+        stats.late_sailings = group.second.late_sailings;
+        stats.mean_delay = static_cast<double>(group.second.total_delay) / group.second.total_sailings;
+        stats.max_delay = group.second.max_delay;
+        result.push_back(stats);
+    }
+    return result;
+}
+
+/* Names of the group-by dimensions on the command line and in reports. */
+const char* dimension_name(GroupDimension dimension)
+{
+    switch (dimension)
+    {
+    case GroupDimension::Route:
+        return "route";
+    case GroupDimension::SourceTerminal:
+        return "source";
+    case GroupDimension::DestTerminal:
+        return "dest";
+    case GroupDimension::Vessel:
+        return "vessel";
+    case GroupDimension::Year:
+        return "year";
+    case GroupDimension::Month:
+        return "month";
+    case GroupDimension::Hour:
+        return "hour";
+    case GroupDimension::Weekday:
+        return "weekday";
+    case GroupDimension::Date:
+        return "date";
+    case GroupDimension::Time:
+        return "time";
+    }
+    return "";
+}
+
+/* Parse a comma-separated list of dimension names. Returns false if any
+   name is unknown. */
+bool parse_group_dimensions(std::string const& list, std::vector<GroupDimension>& dimensions)
+{
+    const GroupDimension all[]{ GroupDimension::Route, GroupDimension::SourceTerminal, GroupDimension::DestTerminal,
+                                GroupDimension::Vessel, GroupDimension::Year, GroupDimension::Month,
+                                GroupDimension::Hour, GroupDimension::Weekday, GroupDimension::Date,
+                                GroupDimension::Time };
+    dimensions.clear();
+    size_t start{ 0 };
+    while (start <= list.size())
+    {
+        const size_t comma{ std::min(list.find(',', start), list.size()) };
+        const std::string name{ list.substr(start, comma - start) };
+        const GroupDimension* found{ std::find_if(std::begin(all), std::end(all), [&name](GroupDimension d) { return name == dimension_name(d); }) };
+        if (found == std::end(all))
+            return false;
+        dimensions.push_back(*found);
+        start = comma + 1;
+    }
+    return true;
+}
+
+void write_group_header(ReportWriter& writer, ReportFormat format, std::vector<GroupDimension> const& dimensions)
+{
+    if (format == ReportFormat::Text)
+    {
+        writer.text("Sailings grouped by");
+        for (size_t d{ 0 }; d < dimensions.size(); d++)
+            writer.text(d == 0 ? " " : ", ").text(dimension_name(dimensions[d]));
+        writer.text(":");
+        writer.end_line();
+    }
+    else if (format == ReportFormat::Csv)
+    {
+        for (GroupDimension dimension : dimensions)
+            writer.text(dimension_name(dimension)).text(",");
+        writer.text("total_sailings,late_sailings,mean_delay,max_delay");
+        writer.end_line();
+    }
+}
+
+void write_group_row(ReportWriter& writer, ReportFormat format, std::vector<GroupDimension> const& dimensions, GroupStatistics const& stats)
+{
+    switch (format)
+    {
+    case ReportFormat::Text:
+        for (size_t d{ 0 }; d < dimensions.size(); d++)
+            writer.text(d == 0 ? "" : ", ").text(dimension_name(dimensions[d])).text(" ").text(stats.labels[d]);
+        writer.text(": ").integer(stats.total_sailings).text(" sailings (").integer(stats.late_sailings).text(" late), ");
+        writer.text("mean delay ").fixed(stats.mean_delay, 2).text(" min, max delay ").integer(stats.max_delay).text(" min");
+        break;
+    case ReportFormat::Csv:
+        for (size_t d{ 0 }; d < dimensions.size(); d++)
+            writer.csv_field(stats.labels[d]).text(",");
+        writer.integer(stats.total_sailings).text(",").integer(stats.late_sailings).text(",");
+        writer.fixed(stats.mean_delay, 2).text(",").integer(stats.max_delay);
+        break;
+    case ReportFormat::JsonLines:
+        writer.text("{");
+        for (size_t d{ 0 }; d < dimensions.size(); d++)
+            writer.json_string(dimension_name(dimensions[d])).text(":").json_string(stats.labels[d]).text(",");
+        writer.text("\"total_sailings\":").integer(stats.total_sailings).text(",\"late_sailings\":").integer(stats.late_sailings);
+        writer.text(",\"mean_delay\":").fixed(stats.mean_delay, 2).text(",\"max_delay\":").integer(stats.max_delay).text("}");
+        break;
+    }
+    writer.end_line();
+}
+
+template <typename Sailings>
+void print_group_report(ReportWriter& writer, ReportFormat format, std::vector<GroupDimension> const& dimensions, Sailings const& sailings)
+{
+    write_group_header(writer, format, dimensions);
+    for (const GroupStatistics& stats : group_sailings(sailings, dimensions))
+        write_group_row(writer, format, dimensions, stats);
+}
+
+void print_group_report(ReportWriter& writer, ReportFormat, std::vector<GroupDimension> const&, StreamingAggregate const&)
+{
+    writer.text("The group_by action needs stored sailings; it is not available with --checkpoint.");
+    writer.end_line();
+}
+
+/* Date/route index
+   A SailingIndex lists every sailing sorted by route and, within a route,
+   by departure date. A query restricted to one route or to a date range
+   binary-searches each route's run of entries for its slice instead of
+   scanning every sailing, and only the selected rows are copied out for
+   the report. The keys are kept in their own arrays so the searches only
+   touch them. Building the index costs a sort of every sailing, so it is
+   only built where it is reused: the query server makes one per load and
+   answers every request from it. A single report filters with one linear
+   pass instead. */
+
+/* Sort keys and row positions for one table or vector, in index order. */
+struct SailingIndex
+{
+    std::vector<int> route{};
+    std::vector<std::uint64_t> date{};
+    std::vector<std::uint32_t> row{};
+};
+
+/* Build the index from the route and packed date of each of count rows. */
+template <typename RouteAt, typename DateAt>
+SailingIndex make_sailing_index(size_t count, RouteAt route_at, DateAt date_at)
+{
+    struct Entry
+    {
+        int route;
+        std::uint64_t date;
+        std::uint32_t row;
+    };
+    std::vector<Entry> entries(count);
+    for (size_t i{ 0 }; i < count; i++)
+        entries[i] = Entry{ route_at(i), date_at(i), static_cast<std::uint32_t>(i) };
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.route != b.route ? a.route < b.route : a.date != b.date ? a.date < b.date : a.row < b.row;
+    });
+
+    SailingIndex index{};
+    index.route.reserve(count);
+    index.date.reserve(count);
+    index.row.reserve(count);
+    for (const Entry& entry : entries)
+    {
+        index.route.push_back(entry.route);
+        index.date.push_back(entry.date);
+        index.row.push_back(entry.row);
+    }
+    return index;
+}
+
+SailingIndex make_sailing_index(SailingTable const& table)
+{
+    return make_sailing_index(
+        table_size(table), [&table](size_t i) { return table.route_number[i]; },
+        [&table](size_t i) { return pack_date(Date{ table.day[i], table.month[i], table.year[i] }); });
+}
+
+SailingIndex make_sailing_index(std::vector<Sailing> const& sailings)
+{
+    return make_sailing_index(
+        sailings.size(), [&sailings](size_t i) { return sailings[i].route_number; },
+        [&sailings](size_t i) { return pack_date(sailings[i].departure_date); });
+}
+
+/* find_sailings(index, filter)
+   Return the positions of the sailings that pass filter, in increasing
+   order (that is, in the order they were loaded). */
+std::vector<std::uint32_t> find_sailings(SailingIndex const& index, SailingFilter const& filter)
+{
+    const auto route_begin{ index.route.begin() };
+    auto first{ route_begin };
+    auto last{ index.route.end() };
+    if (filter.has_route)
+    {
+        first = std::lower_bound(first, last, filter.route);
+        last = std::upper_bound(first, last, filter.route);
+    }
+
+    const std::uint64_t first_date{ filter.has_first_date ? pack_date(filter.first_date) : 0 };
+    const std::uint64_t last_date{ filter.has_last_date ? pack_date(filter.last_date) : UINT64_MAX };
+    std::vector<std::uint32_t> rows{};
+    while (first != last)
+    {
+        const auto route_end{ std::upper_bound(first, last, *first) };
+        const auto dates_begin{ index.date.begin() + (first - route_begin) };
+        const auto dates_end{ index.date.begin() + (route_end - route_begin) };
+        const auto slice_begin{ std::lower_bound(dates_begin, dates_end, first_date) };
+        const auto slice_end{ std::upper_bound(slice_begin, dates_end, last_date) };
+        rows.insert(rows.end(), index.row.begin() + (slice_begin - index.date.begin()), index.row.begin() + (slice_end - index.date.begin()));
+        first = route_end;
+    }
+    std::sort(rows.begin(), rows.end());
+    return rows;
+}
+
+/* Copy the given rows out of the loaded sailings. */
+std::vector<Sailing> select_sailings(std::vector<Sailing> const& sailings, std::vector<std::uint32_t> const& rows)
+{
+    std::vector<Sailing> selected{};
+    selected.reserve(rows.size());
+    for (std::uint32_t row : rows)
+        selected.push_back(sailings[row]);
+    return selected;
+}
+
+SailingTable select_sailings(SailingTable const& table, std::vector<std::uint32_t> const& rows)
+{
+    SailingTable selected{};
+    reserve_sailings(selected, rows.size());
+    for (std::uint32_t row : rows)
+    {
+        SailingView view{ table.route_number[row], table.terminals.names[table.source_terminal[row]],
+                          table.terminals.names[table.dest_terminal[row]], table.vessels.names[table.vessel[row]],
+                          Date{ table.day[row], table.month[row], table.year[row] },
+                          TimeOfDay{ table.hour[row], table.minute[row] },
+                          table.expected_duration[row], table.actual_duration[row] };
+        append_sailing(selected, view);
+    }
+    return selected;
+}
+
+/* True if the driver was asked to restrict the report to some sailings. */
+bool filter_is_set(SailingFilter const& filter)
+{
+    return filter.has_route || filter.has_first_date || filter.has_last_date || filter.has_min_delay;
+}
+
+long long sailing_delay(std::vector<Sailing> const& sailings, std::uint32_t row)
+{
+    return static_cast<long long>(sailings[row].actual_duration) - sailings[row].expected_duration;
+}
+
+long long sailing_delay(SailingTable const& table, std::uint32_t row)
+{
+    return static_cast<long long>(table.actual_duration[row]) - table.expected_duration[row];
+}
+
+/* filtered_rows(sailings, index, filter)
+   The positions of the sailings that pass filter, in load order. Route and
+   dates are looked up in index, the index of sailings; --min-delay is
+   checked row by row. */
+template <typename Sailings>
+std::vector<std::uint32_t> filtered_rows(Sailings const& sailings, SailingIndex const& index, SailingFilter const& filter)
+{
+    std::vector<std::uint32_t> rows{ find_sailings(index, filter) };
+    if (filter.has_min_delay)
+        rows.erase(std::remove_if(rows.begin(), rows.end(),
+                                  [&](std::uint32_t row) { return sailing_delay(sailings, row) < filter.min_delay; }),
+                   rows.end());
+    return rows;
+}
+
+/* True if one sailing passes filter. */
+bool sailing_matches(SailingFilter const& filter, int route_number, const Date& date, int expected_duration, int actual_duration)
+{
+    const std::uint64_t packed{ pack_date(date) };
+    return (!filter.has_route || route_number == filter.route)
+        && (!filter.has_first_date || packed >= pack_date(filter.first_date))
+        && (!filter.has_last_date || packed <= pack_date(filter.last_date))
+        && (!filter.has_min_delay || static_cast<long long>(actual_duration) - expected_duration >= filter.min_delay);
+}
+
+/* filtered_rows(sailings, filter)
+   The positions of the sailings that pass filter, in load order, from one
+   pass over them without an index. */
+std::vector<std::uint32_t> filtered_rows(std::vector<Sailing> const& sailings, SailingFilter const& filter)
+{
+    std::vector<std::uint32_t> rows{};
+    for (size_t i{ 0 }; i < sailings.size(); i++)
+    {
+        const Sailing& sailing{ sailings[i] };
+        if (sailing_matches(filter, sailing.route_number, sailing.departure_date, sailing.expected_duration, sailing.actual_duration))
+            rows.push_back(static_cast<std::uint32_t>(i));
+    }
+    return rows;
+}
+
+std::vector<std::uint32_t> filtered_rows(SailingTable const& table, SailingFilter const& filter)
+{
+    std::vector<std::uint32_t> rows{};
+    for (size_t i{ 0 }; i < table_size(table); i++)
+    {
+        if (sailing_matches(filter, table.route_number[i], Date{ table.day[i], table.month[i], table.year[i] }, table.expected_duration[i], table.actual_duration[i]))
+            rows.push_back(static_cast<std::uint32_t>(i));
+    }
+    return rows;
+}
+
+/* run_filtered_action(options, sailings)
+   Run the action on the sailings that pass options.filter, or on all of
+   them if no filter was given. */
+template <typename Sailings>
+bool run_filtered_action(DriverOptions const& options, Sailings const& sailings)
+{
+    if (!filter_is_set(options.filter))
+        return run_action(options, sailings, std::cout);
+
+    const std::vector<std::uint32_t> rows{ filtered_rows(sailings, options.filter) };
+    diagnostic_stream(options) << "Selected " << rows.size() << " sailings." << std::endl;
+    return run_action(options, select_sailings(sailings, rows), std::cout);
+}
+
+/* Parse a whole command-line value as a decimal integer of value's type,
+   so 64-bit options are not limited to the range of an int. Unlike
+   parse_int_field, no surrounding text is allowed. */
+template <typename Integer>
+bool parse_int_option(std::string_view text, Integer& value)
+{
+    const char* end{ text.data() + text.size() };
+    const auto parsed{ std::from_chars(text.data(), end, value) };
+    return !text.empty() && parsed.ec == std::errc{} && parsed.ptr == end;
+}
+
+/* Parse a date given on the command line as YYYY-MM-DD. Dates that are
+   not on the calendar, such as 2022-02-31, are rejected. */
+bool parse_date_option(std::string const& text, Date& date)
+{
+    const size_t first_dash{ text.find('-') };
+    const size_t second_dash{ first_dash == std::string::npos ? first_dash : text.find('-', first_dash + 1) };
+    if (second_dash == std::string::npos)
+        return false;
+
+    const std::string_view view{ text };
+    Date parsed{};
+    if (!parse_int_option(view.substr(0, first_dash), parsed.year)
+        || !parse_int_option(view.substr(first_dash + 1, second_dash - first_dash - 1), parsed.month)
+        || !parse_int_option(view.substr(second_dash + 1), parsed.day))
+        return false;
+    date = parsed;
+    return date.month >= 1 && date.month <= 12 && date.day >= 1 && date.day <= days_in_month(date.year, date.month);
+}
+
+/* Columnar archives
+   An archive (written by the archive action, usually as *.sailcol) is a
+   compressed column store of the valid sailings of an input file, for
+   keeping long histories. The sailings are sorted by route, date and
+   departure time and cut into blocks of archive_block_rows. The load order
+   is not kept (a row permutation would cost about as much as the rest of
+   the archive), so reports that follow input order list sailings, routes
+   and ties in archive order instead. Inside a block:
+
+     route          runs of (zigzag delta from the previous run, length)
+     date           runs of (zigzag deltas of year, month and day, length)
+     time           zigzag delta of the minute of the day from the row before
+     terminals,     dictionary ids, bit-packed at the width of the largest id
+     vessel
+     durations      frame of reference: the block minimum, then each value
+                    minus the minimum, bit-packed at the width of the range
+
+   All integers outside the bit-packed columns are LEB128 varints, so the
+   file does not depend on the byte order of the machine. The file starts
+   with archive_magic, a version number, the terminal and vessel names and
+   a zone map for every block (row count, byte size, and the smallest and
+   largest route, date and delay in it). A reader compares --route,
+   --from, --to and --min-delay with the zone maps first and skips the
+   blocks that cannot match without decoding them. Layout:
+
+     archive_magic, version
+     terminal names, vessel names: count, then length + bytes each
+     block count, then one ArchiveZoneMap per block
+     the blocks, in order */
+
+const char archive_magic[8]{ 'S', 'A', 'I', 'L', 'C', 'O', 'L', 'S' };
+const std::uint64_t archive_version{ 1 };
+const size_t archive_block_rows{ 1 << 14 };
+
+struct ArchiveZoneMap
+{
+    std::uint64_t rows{ 0 };
+    std::uint64_t bytes{ 0 };
+    int min_route{ 0 };
+    int max_route{ 0 };
+    std::uint64_t min_date{ 0 };     // pack_date
+    std::uint64_t max_date{ 0 };
+    long long min_delay{ 0 };
+    long long max_delay{ 0 };
+};
+
+std::uint64_t zigzag_encode(long long value)
+{
+    return (static_cast<std::uint64_t>(value) << 1) ^ (value < 0 ? ~std::uint64_t{ 0 } : 0);
+}
+
+long long zigzag_decode(std::uint64_t value)
+{
+    return static_cast<long long>((value >> 1) ^ (0 - (value & 1)));
+}
+
+void write_varint(std::string& output, std::uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        output.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    output.push_back(static_cast<char>(value));
+}
+
+std::uint64_t read_varint(BinaryReader& reader)
+{
+    std::uint64_t value{ 0 };
+    for (int shift{ 0 }; shift < 64 && reader.ok; shift += 7)
+    {
+        if (reader.position >= reader.data.size())
+            break;
+        const unsigned char byte{ static_cast<unsigned char>(reader.data[reader.position++]) };
+        value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return value;
+    }
+    reader.ok = false;
+    return 0;
+}
+
+/* Number of bits needed to store values up to max_value. */
+int bit_width_of(std::uint64_t max_value)
+{
+    int width{ 0 };
+    while (width < 64 && (max_value >> width) != 0)
+        width++;
+    return width;
+}
+
+/* Appends values of a fixed bit width to a byte string, low bits first. */
+struct BitWriter
+{
+    std::string& output;
+    std::uint64_t pending{ 0 };
+    int pending_bits{ 0 };
+
+    void put(std::uint64_t value, int width)
+    {
+        while (width > 0)
+        {
+            const int take{ std::min(width, 32) };
+            pending |= (value & ((std::uint64_t{ 1 } << take) - 1)) << pending_bits;
+            pending_bits += take;
+            value >>= take;
+            width -= take;
+            while (pending_bits >= 8)
+            {
+                output.push_back(static_cast<char>(pending & 0xFF));
+                pending >>= 8;
+                pending_bits -= 8;
+            }
+        }
+    }
+
+    void finish()
+    {
+        if (pending_bits > 0)
+            output.push_back(static_cast<char>(pending & 0xFF));
+        pending = 0;
+        pending_bits = 0;
+    }
+};
+
+/* Reads what BitWriter wrote. Reading past the end clears reader.ok. */
+struct BitReader
+{
+    BinaryReader& reader;
+    std::uint64_t pending{ 0 };
+    int pending_bits{ 0 };
+
+    std::uint64_t get(int width)
+    {
+        std::uint64_t value{ 0 };
+        int filled{ 0 };
+        while (filled < width)
+        {
+            if (pending_bits == 0)
+            {
+                if (reader.position >= reader.data.size())
+                {
+                    reader.ok = false;
+                    return 0;
+                }
+                pending = static_cast<unsigned char>(reader.data[reader.position++]);
+                pending_bits = 8;
+            }
+            const int take{ std::min(width - filled, pending_bits) };
+            value |= (pending & ((std::uint64_t{ 1 } << take) - 1)) << filled;
+            pending >>= take;
+            pending_bits -= take;
+            filled += take;
+        }
+        return value;
+    }
+};
+
+/* Run-length encode one key of rows [begin, end): same_key(a, b) tells
+   whether two rows belong to the same run, and each run is written by
+   write_run(first row of the run, length), after the number of runs. */
+template <typename SameKey, typename WriteRun>
+void write_runs(std::string& output, std::vector<std::uint32_t> const& rows, size_t begin, size_t end, SameKey same_key, WriteRun write_run)
+{
+    std::vector<std::pair<size_t, size_t>> runs{};
+    for (size_t i{ begin }; i < end; i++)
+    {
+        if (runs.empty() || !same_key(rows[runs.back().first], rows[i]))
+            runs.emplace_back(i, 0);
+        runs.back().second++;
+    }
+    write_varint(output, runs.size());
+    for (const auto& run : runs)
+        write_run(rows[run.first], run.second);
+}
+
+/* Bit-pack one integer column of the block with a frame of reference. */
+void write_packed_column(std::string& output, std::vector<int> const& column, std::vector<std::uint32_t> const& rows, size_t begin, size_t end)
+{
+    long long low{ column[rows[begin]] };
+    long long high{ low };
+    for (size_t i{ begin }; i < end; i++)
+    {
+        low = std::min<long long>(low, column[rows[i]]);
+        high = std::max<long long>(high, column[rows[i]]);
+    }
+    const int width{ bit_width_of(static_cast<std::uint64_t>(high - low)) };
+    write_varint(output, zigzag_encode(low));
+    write_varint(output, static_cast<std::uint64_t>(width));
+    BitWriter bits{ output };
+    for (size_t i{ begin }; i < end; i++)
+        bits.put(static_cast<std::uint64_t>(column[rows[i]] - low), width);
+    bits.finish();
+}
+
+void write_packed_ids(std::string& output, std::vector<std::uint32_t> const& column, std::vector<std::uint32_t> const& rows, size_t begin, size_t end, int width)
+{
+    BitWriter bits{ output };
+    for (size_t i{ begin }; i < end; i++)
+        bits.put(column[rows[i]], width);
+    bits.finish();
+}
+
+/* Encode rows [begin, end) of the sorted order into block and fill in its
+   zone map. */
+void encode_archive_block(SailingTable const& table, std::vector<std::uint32_t> const& rows, size_t begin, size_t end,
+                          int terminal_width, int vessel_width, std::string& block, ArchiveZoneMap& zone)
+{
+    zone = ArchiveZoneMap{};
+    zone.rows = end - begin;
+    for (size_t i{ begin }; i < end; i++)
+    {
+        const std::uint32_t row{ rows[i] };
+        const std::uint64_t date{ pack_date(Date{ table.day[row], table.month[row], table.year[row] }) };
+        const long long delay{ static_cast<long long>(table.actual_duration[row]) - table.expected_duration[row] };
+        const bool first{ i == begin };
+        zone.min_route = first ? table.route_number[row] : std::min(zone.min_route, table.route_number[row]);
+        zone.max_route = first ? table.route_number[row] : std::max(zone.max_route, table.route_number[row]);
+        zone.min_date = first ? date : std::min(zone.min_date, date);
+        zone.max_date = first ? date : std::max(zone.max_date, date);
+        zone.min_delay = first ? delay : std::min(zone.min_delay, delay);
+        zone.max_delay = first ? delay : std::max(zone.max_delay, delay);
+    }
+
+    long long previous_route{ 0 };
+    write_runs(block, rows, begin, end,
+               [&table](std::uint32_t a, std::uint32_t b) { return table.route_number[a] == table.route_number[b]; },
+               [&](std::uint32_t row, size_t length) {
+                   write_varint(block, zigzag_encode(table.route_number[row] - previous_route));
+                   write_varint(block, length);
+                   previous_route = table.route_number[row];
+               });
+
+    long long previous_year{ 0 };
+    long long previous_month{ 0 };
+    long long previous_day{ 0 };
+    write_runs(block, rows, begin, end,
+               [&table](std::uint32_t a, std::uint32_t b) {
+                   return table.route_number[a] == table.route_number[b] && table.year[a] == table.year[b]
+                       && table.month[a] == table.month[b] && table.day[a] == table.day[b];
+               },
+               [&](std::uint32_t row, size_t length) {
+                   write_varint(block, zigzag_encode(table.year[row] - previous_year));
+                   write_varint(block, zigzag_encode(table.month[row] - previous_month));
+                   write_varint(block, zigzag_encode(table.day[row] - previous_day));
+                   write_varint(block, length);
+                   previous_year = table.year[row];
+                   previous_month = table.month[row];
+                   previous_day = table.day[row];
+               });
+
+    long long previous_minute{ 0 };
+    for (size_t i{ begin }; i < end; i++)
+    {
+        const long long minute{ to_minute_of_day(TimeOfDay{ table.hour[rows[i]], table.minute[rows[i]] }) };
+        write_varint(block, zigzag_encode(minute - previous_minute));
+        previous_minute = minute;
+    }
+
+    write_packed_ids(block, table.source_terminal, rows, begin, end, terminal_width);
+    write_packed_ids(block, table.dest_terminal, rows, begin, end, terminal_width);
+    write_packed_ids(block, table.vessel, rows, begin, end, vessel_width);
+    write_packed_column(block, table.expected_duration, rows, begin, end);
+    write_packed_column(block, table.actual_duration, rows, begin, end);
+}
+
+void write_archive_names(std::string& output, NameDictionary const& dictionary)
+{
+    write_varint(output, dictionary.names.size());
+    for (const std::string& name : dictionary.names)
+    {
+        write_varint(output, name.size());
+        output += name;
+    }
+}
+
+/* write_sailing_archive(filename, table)
+   Write table to filename as a columnar archive (see above). The file is
+   written under a temporary name and renamed into place. Returns false if
+   it could not be written. */
+bool write_sailing_archive(std::string const& filename, SailingTable const& table)
+{
+    std::vector<std::uint32_t> rows(table_size(table));
+    for (size_t i{ 0 }; i < rows.size(); i++)
+        rows[i] = static_cast<std::uint32_t>(i);
+    std::sort(rows.begin(), rows.end(), [&table](std::uint32_t a, std::uint32_t b) {
+        if (table.route_number[a] != table.route_number[b])
+            return table.route_number[a] < table.route_number[b];
+        if (table.year[a] != table.year[b])
+            return table.year[a] < table.year[b];
+        if (table.month[a] != table.month[b])
+            return table.month[a] < table.month[b];
+        if (table.day[a] != table.day[b])
+            return table.day[a] < table.day[b];
+        return to_minute_of_day(TimeOfDay{ table.hour[a], table.minute[a] }) < to_minute_of_day(TimeOfDay{ table.hour[b], table.minute[b] });
+    });
+
+    const int terminal_width{ bit_width_of(table.terminals.names.empty() ? 0 : table.terminals.names.size() - 1) };
+    const int vessel_width{ bit_width_of(table.vessels.names.empty() ? 0 : table.vessels.names.size() - 1) };
+    std::vector<ArchiveZoneMap> zones{};
+    std::vector<std::string> blocks{};
+    for (size_t begin{ 0 }; begin < rows.size(); begin += archive_block_rows)
+    {
+        zones.emplace_back();
+        blocks.emplace_back();
+        encode_archive_block(table, rows, begin, std::min(rows.size(), begin + archive_block_rows), terminal_width, vessel_width, blocks.back(), zones.back());
+        zones.back().bytes = blocks.back().size();
+    }
+
+    std::string header{ archive_magic, sizeof(archive_magic) };
+    write_varint(header, archive_version);
+    write_archive_names(header, table.terminals);
+    write_archive_names(header, table.vessels);
+    write_varint(header, zones.size());
+    for (const ArchiveZoneMap& zone : zones)
+    {
+        write_varint(header, zone.rows);
+        write_varint(header, zone.bytes);
+        write_varint(header, zigzag_encode(zone.min_route));
+        write_varint(header, zigzag_encode(zone.max_route));
+        write_varint(header, zone.min_date);
+        write_varint(header, zone.max_date);
+        write_varint(header, zigzag_encode(zone.min_delay));
+        write_varint(header, zigzag_encode(zone.max_delay));
+    }
+
+    const std::string temporary_filename{ temporary_filename_for(filename) };
+    {
+        std::ofstream output{ temporary_filename, std::ios::binary | std::ios::trunc };
+        if (!output.is_open())
+            return false;
+        output.write(header.data(), static_cast<std::streamsize>(header.size()));
+        for (const std::string& block : blocks)
+            output.write(block.data(), static_cast<std::streamsize>(block.size()));
+        if (!output.good())
+        {
+            output.close();
+            std::filesystem::remove(temporary_filename);
+            return false;
+        }
+    }
+    return rename_into_place(temporary_filename, filename);
+}
+
+/* True if filename starts with archive_magic. */
+bool is_sailing_archive(std::string const& filename)
+{
+    std::ifstream input_file{ filename, std::ios::binary };
+    char magic[sizeof(archive_magic)]{};
+    return input_file.read(magic, sizeof(magic)) && std::memcmp(magic, archive_magic, sizeof(magic)) == 0;
+}
+
+/* True if some row of a block with this zone map could pass filter. */
+bool zone_may_match(ArchiveZoneMap const& zone, SailingFilter const& filter)
+{
+    if (filter.has_route && (filter.route < zone.min_route || filter.route > zone.max_route))
+        return false;
+    if (filter.has_first_date && zone.max_date < pack_date(filter.first_date))
+        return false;
+    if (filter.has_last_date && zone.min_date > pack_date(filter.last_date))
+        return false;
+    return !filter.has_min_delay || zone.max_delay >= filter.min_delay;
+}
+
+/* Read what write_runs wrote for a block of rows rows. read_run(first)
+   decodes one run starting at row first and returns its length. */
+template <typename ReadRun>
+void read_runs(BinaryReader& reader, size_t rows, ReadRun read_run)
+{
+    const std::uint64_t runs{ read_varint(reader) };
+    size_t filled{ 0 };
+    for (std::uint64_t r{ 0 }; r < runs && reader.ok; r++)
+        filled += read_run(filled);
+    if (filled != rows)
+        reader.ok = false;
+}
+
+void read_packed_column(BinaryReader& reader, std::vector<int>& column, size_t rows)
+{
+    const long long low{ zigzag_decode(read_varint(reader)) };
+    const int width{ static_cast<int>(read_varint(reader)) };
+    if (width > 33)
+        reader.ok = false;
+    column.resize(rows);
+    BitReader bits{ reader };
+    for (size_t i{ 0 }; i < rows && reader.ok; i++)
+        column[i] = static_cast<int>(low + static_cast<long long>(bits.get(width)));
+}
+
+void read_packed_ids(BinaryReader& reader, std::vector<std::uint32_t>& column, size_t rows, int width, size_t name_count)
+{
+    column.resize(rows);
+    BitReader bits{ reader };
+    for (size_t i{ 0 }; i < rows && reader.ok; i++)
+    {
+        column[i] = static_cast<std::uint32_t>(bits.get(width));
+        if (column[i] >= name_count)
+            reader.ok = false;
+    }
+}
+
+/* Decode one block into the columns of block (whose dictionaries are not
+   used). Returns false if the block is malformed. */
+bool decode_archive_block(std::string_view data, size_t rows, int terminal_width, int vessel_width,
+                          size_t terminal_count, size_t vessel_count, SailingTable& block)
+{
+    BinaryReader reader{ data };
+    block.route_number.assign(rows, 0);
+    block.year.assign(rows, 0);
+    block.month.assign(rows, 0);
+    block.day.assign(rows, 0);
+
+    long long route{ 0 };
+    read_runs(reader, rows, [&](size_t first) {
+        route += zigzag_decode(read_varint(reader));
+        const size_t length{ static_cast<size_t>(read_varint(reader)) };
+        if (!reader.ok || length > rows - first)
+        {
+            reader.ok = false;
+            return rows;
+        }
+        std::fill_n(block.route_number.begin() + first, length, static_cast<int>(route));
+        return length;
+    });
+
+    long long year{ 0 };
+    long long month{ 0 };
+    long long day{ 0 };
+    read_runs(reader, rows, [&](size_t first) {
+        year += zigzag_decode(read_varint(reader));
+        month += zigzag_decode(read_varint(reader));
+        day += zigzag_decode(read_varint(reader));
+        const size_t length{ static_cast<size_t>(read_varint(reader)) };
+        if (!reader.ok || length > rows - first)
+        {
+            reader.ok = false;
+            return rows;
+        }
+        std::fill_n(block.year.begin() + first, length, static_cast<int>(year));
+        std::fill_n(block.month.begin() + first, length, static_cast<int>(month));
+        std::fill_n(block.day.begin() + first, length, static_cast<int>(day));
+        return length;
+    });
+
+    block.hour.resize(rows);
+    block.minute.resize(rows);
+    long long minute{ 0 };
+    for (size_t i{ 0 }; i < rows && reader.ok; i++)
+    {
+        minute += zigzag_decode(read_varint(reader));
+        if (minute < 0 || minute >= 24 * 60)
+            reader.ok = false;
+        const TimeOfDay time{ from_minute_of_day(static_cast<MinuteOfDay>(minute)) };
+        block.hour[i] = static_cast<std::uint8_t>(time.hour);
+        block.minute[i] = static_cast<std::uint8_t>(time.minute);
+    }
+
+    read_packed_ids(reader, block.source_terminal, rows, terminal_width, terminal_count);
+    read_packed_ids(reader, block.dest_terminal, rows, terminal_width, terminal_count);
+    read_packed_ids(reader, block.vessel, rows, vessel_width, vessel_count);
+    read_packed_column(reader, block.expected_duration, rows);
+    read_packed_column(reader, block.actual_duration, rows);
+    return reader.ok && reader.position == reader.data.size();
+}
+
+void read_archive_names(BinaryReader& reader, NameDictionary& dictionary)
+{
+    const std::uint64_t count{ read_varint(reader) };
+    for (std::uint64_t i{ 0 }; i < count && reader.ok; i++)
+    {
+        const std::uint64_t length{ read_varint(reader) };
+        if (!reader.ok || reader.data.size() - reader.position < length)
+        {
+            reader.ok = false;
+            return;
+        }
+        intern_name(dictionary, reader.data.substr(reader.position, static_cast<size_t>(length)));
+        reader.position += static_cast<size_t>(length);
+    }
+}
+
+/* read_sailing_archive(filename, filter, report)
+   Load the sailings in the archive filename that pass filter. Blocks whose
+   zone maps rule out every row are skipped without being decoded; rows of
+   the other blocks are checked one by one. Writes the number of records
+   and of blocks decoded to report. Throws std::runtime_error if the file
+   is not a valid archive. */
+SailingTable read_sailing_archive(std::string const& filename, SailingFilter const& filter, std::ostream& report)
+{
+    const MappedFile archive{ filename };
+    BinaryReader reader{ archive.contents() };
+    char magic[sizeof(archive_magic)]{};
+    if (!read_binary(reader, magic, sizeof(magic)) || std::memcmp(magic, archive_magic, sizeof(magic)) != 0
+        || read_varint(reader) != archive_version)
+        throw std::runtime_error("Unsupported archive file");
+
+    SailingTable table{};
+    read_archive_names(reader, table.terminals);
+    read_archive_names(reader, table.vessels);
+    const std::uint64_t block_count{ read_varint(reader) };
+    std::vector<ArchiveZoneMap> zones{};
+    for (std::uint64_t b{ 0 }; b < block_count && reader.ok; b++)
+    {
+        ArchiveZoneMap zone{};
+        zone.rows = read_varint(reader);
+        zone.bytes = read_varint(reader);
+        zone.min_route = static_cast<int>(zigzag_decode(read_varint(reader)));
+        zone.max_route = static_cast<int>(zigzag_decode(read_varint(reader)));
+        zone.min_date = read_varint(reader);
+        zone.max_date = read_varint(reader);
+        zone.min_delay = zigzag_decode(read_varint(reader));
+        zone.max_delay = zigzag_decode(read_varint(reader));
+        if (zone.rows > archive_block_rows)
+            reader.ok = false;
+        zones.push_back(zone);
+    }
+    if (!reader.ok)
+        throw std::runtime_error("Corrupt archive file");
+
+    const size_t terminal_count{ table.terminals.names.size() };
+    const size_t vessel_count{ table.vessels.names.size() };
+    const int terminal_width{ bit_width_of(terminal_count == 0 ? 0 : terminal_count - 1) };
+    const int vessel_width{ bit_width_of(vessel_count == 0 ? 0 : vessel_count - 1) };
+    size_t offset{ reader.position };
+    size_t decoded{ 0 };
+    SailingTable block{};
+    for (const ArchiveZoneMap& zone : zones)
+    {
+        if (archive.contents().size() - offset < zone.bytes)
+            throw std::runtime_error("Corrupt archive file");
+        const std::string_view data{ archive.contents().substr(offset, static_cast<size_t>(zone.bytes)) };
+        offset += static_cast<size_t>(zone.bytes);
+        if (!zone_may_match(zone, filter))
+            continue;
+
+        const size_t rows{ static_cast<size_t>(zone.rows) };
+        if (!decode_archive_block(data, rows, terminal_width, vessel_width, terminal_count, vessel_count, block))
+            throw std::runtime_error("Corrupt archive file");
+        decoded++;
+        for (size_t i{ 0 }; i < rows; i++)
+        {
+            if (!sailing_matches(filter, block.route_number[i], Date{ block.day[i], block.month[i], block.year[i] },
+                                 block.expected_duration[i], block.actual_duration[i]))
+                continue;
+            table.route_number.push_back(block.route_number[i]);
+            table.source_terminal.push_back(block.source_terminal[i]);
+            table.dest_terminal.push_back(block.dest_terminal[i]);
+            table.vessel.push_back(block.vessel[i]);
+            table.year.push_back(block.year[i]);
+            table.month.push_back(block.month[i]);
+            table.day.push_back(block.day[i]);
+            table.hour.push_back(block.hour[i]);
+            table.minute.push_back(block.minute[i]);
+            table.expected_duration.push_back(block.expected_duration[i]);
+            table.actual_duration.push_back(block.actual_duration[i]);
+        }
+    }
+
+    report << "Read " << table_size(table) << " records from archive (" << decoded << " of " << zones.size() << " blocks decoded)." << std::endl;
+    return table;
+}
+
+/* archive_sailings(options)
+   The archive action: load options.input_filename (a text file, a
+   directory or pattern, or an archive) and write the sailings that pass
+   options.filter to options.output, or input_filename + ".sailcol". Returns
+   false if the archive could not be written. */
+bool archive_sailings(DriverOptions const& options)
+{
+    std::ostream& report{ diagnostic_stream(options) };
+    SailingTable table{};
+    if (is_sailing_archive(options.input_filename))
+    {
+        table = read_sailing_archive(options.input_filename, options.filter, report);
+    }
+    else
+    {
+        table = is_multi_file_input(options.input_filename) ? read_sailing_files(options.input_filename, options.loader, load_report(options))
+                                                            : read_sailing_table(options.input_filename, options.loader, load_report(options));
+        if (filter_is_set(options.filter))
+        {
+            const std::vector<std::uint32_t> rows{ filtered_rows(table, options.filter) };
+            report << "Selected " << rows.size() << " sailings." << std::endl;
+            table = select_sailings(table, rows);
+        }
+    }
+
+    const std::string output_filename{ options.output.empty() ? options.input_filename + ".sailcol" : options.output };
+    if (!write_sailing_archive(output_filename, table))
+    {
+        std::cout << "Unable to write archive " << output_filename << std::endl;
+        return false;
+    }
+    std::error_code error{};
+    const auto bytes{ std::filesystem::file_size(output_filename, error) };
+    report << "Wrote " << table_size(table) << " sailings to " << output_filename << " ("
+           << (table_size(table) + archive_block_rows - 1) / archive_block_rows << " blocks, " << (error ? 0 : bytes) << " bytes)." << std::endl;
+    return true;
+}
+
+/* External group-by
+   With --storage=none, group_by streams the input and aggregates it within
+   a memory budget (--memory, in MiB) instead of storing the sailings, so
+   group-bys with very many groups (vessel by date over years, say) work on
+   inputs of any size. The partial totals are kept in a hash table keyed by
+   the group's values. When the table grows past the budget, every entry is
+   appended to one of spill_partitions temporary files, chosen by a hash of
+   its key, and the table is emptied. At the end each partition is read
+   back on its own and its entries are merged; a partition that still does
+   not fit is split again with another hash, up to max_spill_depth times.
+   Each finished partition is written out as a run sorted by key, and the
+   runs are merged to print the groups in order. Only one record per run is
+   in memory during that merge, and at most max_open_runs runs are open at
+   once; with more, groups of them are first merged into longer runs.
+
+   The budget covers the whole table: keys, nodes, the bucket array, and a
+   pointer per entry used to sort the entries in place when they are
+   written out in key order, so no second copy of the table is made.
+
+   A group key is the requested values encoded so that comparing keys
+   byte by byte orders them like the labels of group_sailings: integers
+   as big-endian with the sign bit flipped, names with their 0 bytes
+   escaped and a 0 0 terminator, dates as year, month and day, times as
+   the minute of the day. Spill and run records are a varint key length,
+   the key, then the four totals as zigzag varints. */
+const size_t spill_partitions{ 64 };
+const int max_spill_depth{ 3 };
+const size_t group_entry_overhead{ 96 };
+const size_t max_open_runs{ 64 };
+
+void append_key_int(std::string& key, int value)
+{
+    const std::uint32_t biased{ static_cast<std::uint32_t>(value) ^ 0x80000000u };
+    for (int shift{ 24 }; shift >= 0; shift -= 8)
+        key.push_back(static_cast<char>((biased >> shift) & 0xFF));
+}
+
+void append_key_name(std::string& key, std::string_view name)
+{
+    for (char c : name)
+    {
+        key.push_back(c);
+        if (c == '\0')
+            key.push_back('\xFF');
+    }
+    key.append(2, '\0');
+}
+
+int read_key_int(std::string_view key, size_t& position)
+{
+    std::uint32_t biased{ 0 };
+    for (int i{ 0 }; i < 4 && position < key.size(); i++)
+        biased = (biased << 8) | static_cast<unsigned char>(key[position++]);
+    return static_cast<int>(biased ^ 0x80000000u);
+}
+
+std::string read_key_name(std::string_view key, size_t& position)
+{
+    std::string name{};
+    while (position < key.size())
+    {
+        const char c{ key[position++] };
+        if (c != '\0')
+        {
+            name.push_back(c);
+            continue;
+        }
+        if (position < key.size() && key[position++] == '\xFF')
+            name.push_back('\0');
+        else
+            break;
+    }
+    return name;
+}
+
+/* Append the key bytes of one sailing's value for dimension. */
+void append_group_key(std::string& key, GroupDimension dimension, const SailingView& view)
+{
+    const Date& date{ view.departure_date };
+    switch (dimension)
+    {
+    case GroupDimension::Route:
+        append_key_int(key, view.route_number);
+        break;
+    case GroupDimension::SourceTerminal:
+        append_key_name(key, view.source_terminal);
+        break;
+    case GroupDimension::DestTerminal:
+        append_key_name(key, view.dest_terminal);
+        break;
+    case GroupDimension::Vessel:
+        append_key_name(key, view.vessel_name);
+        break;
+    case GroupDimension::Year:
+        append_key_int(key, date.year);
+        break;
+    case GroupDimension::Month:
+        append_key_int(key, date.month);
+        break;
+    case GroupDimension::Hour:
+        append_key_int(key, view.scheduled_departure_time.hour);
+        break;
+    case GroupDimension::Weekday:
+        key.push_back(static_cast<char>(weekday_of(date)));
+        break;
+    case GroupDimension::Date:
+        append_key_int(key, date.year);
+        append_key_int(key, date.month);
+        append_key_int(key, date.day);
+        break;
+    case GroupDimension::Time:
+        append_key_int(key, to_minute_of_day(view.scheduled_departure_time));
+        break;
+    }
+}
+
+/* The labels group_sailings would give the values encoded in key. */
+std::vector<std::string> group_key_labels(std::string_view key, std::vector<GroupDimension> const& dimensions)
+{
+    const char* const weekday_names[]{ "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "?" };
+    std::vector<std::string> labels{};
+    size_t position{ 0 };
+    for (GroupDimension dimension : dimensions)
+    {
+        switch (dimension)
+        {
+        case GroupDimension::SourceTerminal:
+        case GroupDimension::DestTerminal:
+        case GroupDimension::Vessel:
+            labels.push_back(read_key_name(key, position));
+            break;
+        case GroupDimension::Weekday:
+            labels.push_back(weekday_names[position < key.size() ? std::min(7, static_cast<int>(key[position++])) : 7]);
+            break;
+        case GroupDimension::Date:
+        {
+            const int year{ read_key_int(key, position) };
+            const int month{ read_key_int(key, position) };
+            const int day{ read_key_int(key, position) };
+            labels.push_back(std::to_string(year) + "-" + std::to_string(month) + "-" + std::to_string(day));
+            break;
+        }
+        case GroupDimension::Time:
+            labels.push_back(time_label(read_key_int(key, position)));
+            break;
+        default:
+            labels.push_back(std::to_string(read_key_int(key, position)));
+            break;
+        }
+    }
+    return labels;
+}
+
+void merge_group_accumulator(GroupAccumulator& into, GroupAccumulator const& from)
+{
+    into.total_sailings += from.total_sailings;
+    into.late_sailings += from.late_sailings;
+    into.total_delay += from.total_delay;
+    into.max_delay = std::max(into.max_delay, from.max_delay);
+}
+
+void write_group_record(std::ostream& output, std::string const& key, GroupAccumulator const& group)
+{
+    std::string record{};
+    write_varint(record, key.size());
+    record += key;
+    write_varint(record, zigzag_encode(group.total_sailings));
+    write_varint(record, zigzag_encode(group.late_sailings));
+    write_varint(record, zigzag_encode(group.total_delay));
+    write_varint(record, zigzag_encode(group.max_delay));
+    output.write(record.data(), static_cast<std::streamsize>(record.size()));
+}
+
+bool read_stream_varint(std::istream& input, std::uint64_t& value)
+{
+    value = 0;
+    for (int shift{ 0 }; shift < 64; shift += 7)
+    {
+        const int byte{ input.get() };
+        if (byte == std::char_traits<char>::eof())
+            return false;
+        value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+/* Read the next record written by write_group_record. Returns false at the
+   end of input; throws std::runtime_error if a record is cut short. */
+bool read_group_record(std::istream& input, std::string& key, GroupAccumulator& group)
+{
+    std::uint64_t length{ 0 };
+    if (!read_stream_varint(input, length))
+        return false;
+    key.resize(static_cast<size_t>(length));
+    std::uint64_t fields[4]{};
+    if (!input.read(&key[0], static_cast<std::streamsize>(length)) || !read_stream_varint(input, fields[0])
+        || !read_stream_varint(input, fields[1]) || !read_stream_varint(input, fields[2]) || !read_stream_varint(input, fields[3]))
+        throw std::runtime_error("Corrupt spill file");
+    group.total_sailings = static_cast<int>(zigzag_decode(fields[0]));
+    group.late_sailings = static_cast<int>(zigzag_decode(fields[1]));
+    group.total_delay = zigzag_decode(fields[2]);
+    group.max_delay = static_cast<int>(zigzag_decode(fields[3]));
+    return true;
+}
+
+/* The partition of key at the given split depth. Each depth mixes the hash
+   differently, so a partition that is split again spreads out. */
+size_t spill_partition(std::string const& key, int depth)
+{
+    std::uint64_t mixed{ std::hash<std::string>{}(key) + 0x9E3779B97F4A7C15ull * static_cast<std::uint64_t>(depth + 1) };
+    mixed = (mixed ^ (mixed >> 30)) * 0xBF58476D1CE4E5B9ull;
+    mixed = (mixed ^ (mixed >> 27)) * 0x94D049BB133111EBull;
+    return static_cast<size_t>((mixed ^ (mixed >> 31)) % spill_partitions);
+}
+
+/* A temporary directory for spill files, removed with everything in it
+   when the object goes out of scope. */
+class SpillDirectory
+{
+public:
+    explicit SpillDirectory(std::string const& parent)
+    {
+        std::error_code error{};
+        const std::filesystem::path base{ parent.empty() ? std::filesystem::temp_directory_path(error) : std::filesystem::path{ parent } };
+        std::random_device random{};
+        for (int attempt{ 0 }; attempt < 16 && path_.empty(); attempt++)
+        {
+            const std::filesystem::path candidate{ base / ("sailing-spill-" + std::to_string(random())) };
+            if (std::filesystem::create_directory(candidate, error))
+                path_ = candidate;
+        }
+        if (path_.empty())
+            throw std::runtime_error("Unable to create a spill directory");
+    }
+
+    ~SpillDirectory()
+    {
+        std::error_code error{};
+        std::filesystem::remove_all(path_, error);
+    }
+
+    SpillDirectory(SpillDirectory const&) = delete;
+    SpillDirectory& operator=(SpillDirectory const&) = delete;
+
+    /* A new file name in the directory. */
+    std::string next_file()
+    {
+        return (path_ / ("part-" + std::to_string(next_++))).string();
+    }
+
+private:
+    std::filesystem::path path_{};
+    size_t next_{ 0 };
+};
+
+/* Partial group totals within a memory budget: the sink the streaming
+   loader feeds in external group-by mode. */
+class SpillingGroupAggregate
+{
+public:
+    SpillingGroupAggregate(std::vector<GroupDimension> const& dimensions, size_t budget_bytes, std::string const& spill_parent)
+        : dimensions_{ dimensions }, budget_bytes_{ budget_bytes }, spill_parent_{ spill_parent }
+    {
+    }
+
+    void add(const SailingView& view)
+    {
+        key_.clear();
+        for (GroupDimension dimension : dimensions_)
+            append_group_key(key_, dimension, view);
+        const auto inserted{ groups_.try_emplace(key_) };
+        if (inserted.second)
+            key_bytes_ += key_.size();
+        add_group_sailing(inserted.first->second, view.expected_duration, view.actual_duration);
+        if (table_bytes(groups_, key_bytes_) > budget_bytes_)
+            spill(groups_, 0, partitions_);
+    }
+
+    /* Write the header and every group, in label order, to writer. Returns
+       the number of times partial totals were spilled to disk. */
+    size_t write_report(ReportWriter& writer, ReportFormat format)
+    {
+        write_group_header(writer, format, dimensions_);
+        if (partitions_.empty())
+        {
+            for (const GroupTable::value_type* group : sorted_entries(groups_))
+                write_group_row(writer, format, dimensions_, group_statistics(group->first, group->second));
+            GroupTable{}.swap(groups_);
+            return spills_;
+        }
+
+        spill(groups_, 0, partitions_);
+        std::vector<std::string> runs{};
+        for (const std::string& partition : partitions_)
+            merge_partition(partition, 1, runs);
+        while (runs.size() > max_open_runs)
+            runs = merge_run_passes(runs);
+        merge_runs(runs, [&](std::string const& key, GroupAccumulator const& group) {
+            write_group_row(writer, format, dimensions_, group_statistics(key, group));
+        });
+        return spills_;
+    }
+
+private:
+    using GroupTable = std::unordered_map<std::string, GroupAccumulator>;
+
+    /* The memory groups holds (see "External group-by"), given the total
+       size of its keys. */
+    static size_t table_bytes(GroupTable const& groups, size_t key_bytes)
+    {
+        return key_bytes + groups.size() * (group_entry_overhead + sizeof(void*)) + groups.bucket_count() * sizeof(void*);
+    }
+
+    /* Pointers to the entries of groups in key order. */
+    static std::vector<const GroupTable::value_type*> sorted_entries(GroupTable const& groups)
+    {
+        std::vector<const GroupTable::value_type*> sorted{};
+        sorted.reserve(groups.size());
+        for (const auto& group : groups)
+            sorted.push_back(&group);
+        std::sort(sorted.begin(), sorted.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+        return sorted;
+    }
+
+    SpillDirectory& directory()
+    {
+        if (!directory_)
+            directory_ = std::make_unique<SpillDirectory>(spill_parent_);
+        return *directory_;
+    }
+
+    /* Append every entry of groups to the partition files for depth
+       (creating them on first use) and empty groups. */
+    void spill(GroupTable& groups, int depth, std::vector<std::string>& partitions)
+    {
+        if (partitions.empty())
+            for (size_t p{ 0 }; p < spill_partitions; p++)
+                partitions.push_back(directory().next_file());
+        std::vector<std::ofstream> outputs{};
+        for (const std::string& partition : partitions)
+        {
+            outputs.emplace_back(partition, std::ios::binary | std::ios::app);
+            if (!outputs.back().is_open())
+                throw std::runtime_error("Unable to write spill file");
+        }
+        for (const auto& group : groups)
+            write_group_record(outputs[spill_partition(group.first, depth)], group.first, group.second);
+        for (std::ofstream& output : outputs)
+            if (!output.flush())
+                throw std::runtime_error("Unable to write spill file");
+        GroupTable{}.swap(groups);
+        if (&groups == &groups_)
+            key_bytes_ = 0;
+        spills_++;
+    }
+
+    /* Merge the records of one partition file into a sorted run (appended
+       to runs), splitting it again if its groups do not fit the budget. */
+    void merge_partition(std::string const& partition, int depth, std::vector<std::string>& runs)
+    {
+        GroupTable groups{};
+        size_t key_bytes{ 0 };
+        std::vector<std::string> subpartitions{};
+        {
+            std::ifstream input{ partition, std::ios::binary };
+            std::string key{};
+            GroupAccumulator group{};
+            while (read_group_record(input, key, group))
+            {
+                const auto inserted{ groups.try_emplace(key) };
+                if (inserted.second)
+                    key_bytes += key.size();
+                merge_group_accumulator(inserted.first->second, group);
+                if (table_bytes(groups, key_bytes) > budget_bytes_ && depth < max_spill_depth)
+                {
+                    spill(groups, depth, subpartitions);
+                    key_bytes = 0;
+                }
+            }
+        }
+        std::filesystem::remove(partition);
+
+        if (!subpartitions.empty())
+        {
+            spill(groups, depth, subpartitions);
+            for (const std::string& subpartition : subpartitions)
+                merge_partition(subpartition, depth + 1, runs);
+            return;
+        }
+        if (groups.empty())
+            return;
+
+        runs.push_back(directory().next_file());
+        std::ofstream output{ runs.back(), std::ios::binary };
+        for (const GroupTable::value_type* group : sorted_entries(groups))
+            write_group_record(output, group->first, group->second);
+        if (!output.flush())
+            throw std::runtime_error("Unable to write spill file");
+    }
+
+    /* Merge runs in groups of max_open_runs into longer runs, removing the
+       merged files. Returns the new runs, in order. */
+    std::vector<std::string> merge_run_passes(std::vector<std::string> const& runs)
+    {
+        std::vector<std::string> merged{};
+        for (size_t first{ 0 }; first < runs.size(); first += max_open_runs)
+        {
+            const std::vector<std::string> group(runs.begin() + static_cast<std::ptrdiff_t>(first),
+                                                 runs.begin() + static_cast<std::ptrdiff_t>(std::min(runs.size(), first + max_open_runs)));
+            merged.push_back(directory().next_file());
+            std::ofstream output{ merged.back(), std::ios::binary };
+            merge_runs(group, [&output](std::string const& key, GroupAccumulator const& group_totals) {
+                write_group_record(output, key, group_totals);
+            });
+            if (!output.flush())
+                throw std::runtime_error("Unable to write spill file");
+            for (const std::string& run : group)
+                std::filesystem::remove(run);
+        }
+        return merged;
+    }
+
+    /* Merge the sorted runs and pass every group to emit in key order.
+       Every key is in exactly one run, so no two runs hold the same group. */
+    template <typename Emit>
+    void merge_runs(std::vector<std::string> const& runs, Emit emit)
+    {
+        struct Head
+        {
+            std::string key{};
+            GroupAccumulator group{};
+            size_t run{ 0 };
+        };
+        const auto later{ [](const Head& a, const Head& b) { return a.key > b.key; } };
+
+        std::vector<std::ifstream> inputs{};
+        std::vector<Head> heads{};
+        for (size_t r{ 0 }; r < runs.size(); r++)
+        {
+            inputs.emplace_back(runs[r], std::ios::binary);
+            Head head{};
+            head.run = r;
+            if (read_group_record(inputs.back(), head.key, head.group))
+                heads.push_back(std::move(head));
+        }
+        std::make_heap(heads.begin(), heads.end(), later);
+        while (!heads.empty())
+        {
+            std::pop_heap(heads.begin(), heads.end(), later);
+            Head& head{ heads.back() };
+            emit(head.key, head.group);
+            if (read_group_record(inputs[head.run], head.key, head.group))
+                std::push_heap(heads.begin(), heads.end(), later);
+            else
+                heads.pop_back();
+        }
+    }
+
+    GroupStatistics group_statistics(std::string const& key, GroupAccumulator const& group) const
+    {
+        GroupStatistics stats{};
+        stats.labels = group_key_labels(key, dimensions_);
+        stats.total_sailings = group.total_sailings;
+        stats.late_sailings = group.late_sailings;
+        stats.mean_delay = static_cast<double>(group.total_delay) / group.total_sailings;
+        stats.max_delay = group.max_delay;
+        return stats;
+    }
+
+    std::vector<GroupDimension> dimensions_{};
+    size_t budget_bytes_{ 0 };
+    std::string spill_parent_{};
+    std::unique_ptr<SpillDirectory> directory_{};
+    GroupTable groups_{};
+    size_t key_bytes_{ 0 };
+    std::vector<std::string> partitions_{};
+    size_t spills_{ 0 };
+    std::string key_{};
+};
+
+void append_sailing(SpillingGroupAggregate& aggregate, const SailingView& view)
+{
+    aggregate.add(view);
+}
+
+void reserve_sailings(SpillingGroupAggregate&, size_t)
+{
+}
+
+/* run_external_group_by(options)
+   The group_by action with --storage=none: stream options.input_filename
+   (or standard input) through a SpillingGroupAggregate with a budget of
+   options.memory_mb MiB and print the groups. */
+void run_external_group_by(DriverOptions const& options)
+{
+    SpillingGroupAggregate aggregate{ options.group_by, static_cast<size_t>(options.memory_mb) << 20, options.spill_directory };
+    stream_sailings_into(options.input_filename, aggregate, load_report(options));
+    ReportWriter writer{ std::cout };
+    const size_t spills{ aggregate.write_report(writer, options.format) };
+    writer.flush();
+    if (spills > 0)
+        diagnostic_stream(options) << "Spilled partial groups to disk " << spills << " times." << std::endl;
+}
+
+/* Delay distributions
+   The delay of a sailing is actual_duration - expected_duration in
+   minutes. A DelayHistogram records delays in fixed buckets in the style of
+   an HDR histogram: one bucket per minute for delays of less than
+   delay_exact_limit minutes either way, then delay_sub_buckets buckets per
+   power of two, so any quantile read back is within about 3% of the true
+   delay. Bucket counts only grow to the largest bucket used (at most
+   delay_bucket_limit per sign), two histograms merge by adding counts, and
+   quantiles come from one walk over the buckets, so percentiles need
+   neither the individual delays nor a sort. */
+
+const int delay_exact_limit{ 128 };
+const int delay_exact_bits{ 7 };
+const int delay_sub_buckets{ 32 };
+const int delay_sub_bucket_bits{ 5 };
+const size_t delay_bucket_limit{ delay_exact_limit + (64 - delay_exact_bits) * delay_sub_buckets };
+
+struct DelayHistogram
+{
+    std::vector<std::uint32_t> early{};     // delays < 0, by bucket of -delay
+    std::vector<std::uint32_t> late{};      // delays >= 0, by bucket of delay
+    std::uint64_t count{ 0 };
+    long long min_delay{ 0 };
+    long long max_delay{ 0 };
+};
+
+/* The bucket for a delay of magnitude minutes (ignoring its sign). */
+size_t delay_bucket(std::uint64_t magnitude)
+{
+    if (magnitude < static_cast<std::uint64_t>(delay_exact_limit))
+        return static_cast<size_t>(magnitude);
+    int exponent{ 0 };
+    while ((magnitude >> (exponent + 1)) != 0)
+        exponent++;
+    const std::uint64_t sub_bucket{ (magnitude >> (exponent - delay_sub_bucket_bits)) - delay_sub_buckets };
+    return static_cast<size_t>(delay_exact_limit + (exponent - delay_exact_bits) * delay_sub_buckets + sub_bucket);
+}
+
+/* The smallest magnitude that falls in bucket, and the number of
+   magnitudes it covers. */
+std::uint64_t delay_bucket_start(size_t bucket)
+{
+    if (bucket < static_cast<size_t>(delay_exact_limit))
+        return bucket;
+    const size_t exponent{ (bucket - delay_exact_limit) / delay_sub_buckets + delay_exact_bits };
+    const std::uint64_t sub_bucket{ (bucket - delay_exact_limit) % delay_sub_buckets };
+    return (delay_sub_buckets + sub_bucket) << (exponent - delay_sub_bucket_bits);
+}
+
+std::uint64_t delay_bucket_width(size_t bucket)
+{
+    if (bucket < static_cast<size_t>(delay_exact_limit))
+        return 1;
+    return std::uint64_t{ 1 } << ((bucket - delay_exact_limit) / delay_sub_buckets + delay_exact_bits - delay_sub_bucket_bits);
+}
+
+void add_delay(DelayHistogram& histogram, long long delay)
+{
+    std::vector<std::uint32_t>& side{ delay < 0 ? histogram.early : histogram.late };
+    const std::uint64_t magnitude{ delay < 0 ? 0 - static_cast<std::uint64_t>(delay) : static_cast<std::uint64_t>(delay) };
+    const size_t bucket{ delay_bucket(magnitude) };
+    if (bucket >= side.size())
+        side.resize(bucket + 1, 0);
+    side[bucket]++;
+
+    histogram.min_delay = histogram.count == 0 ? delay : std::min(histogram.min_delay, delay);
+    histogram.max_delay = histogram.count == 0 ? delay : std::max(histogram.max_delay, delay);
+    histogram.count++;
+}
+
+/* Add the counts in from to into. */
+void merge_delay_histogram(DelayHistogram& into, DelayHistogram const& from)
+{
+    if (from.count == 0)
+        return;
+    into.min_delay = into.count == 0 ? from.min_delay : std::min(into.min_delay, from.min_delay);
+    into.max_delay = into.count == 0 ? from.max_delay : std::max(into.max_delay, from.max_delay);
+    into.count += from.count;
+
+    if (into.early.size() < from.early.size())
+        into.early.resize(from.early.size(), 0);
+    for (size_t b{ 0 }; b < from.early.size(); b++)
+        into.early[b] += from.early[b];
+    if (into.late.size() < from.late.size())
+        into.late.resize(from.late.size(), 0);
+    for (size_t b{ 0 }; b < from.late.size(); b++)
+        into.late[b] += from.late[b];
+}
+
+/* delay_quantile(histogram, fraction)
+   The delay at the given fraction (0 to 1) of the recorded delays, by the
+   nearest-rank rule: the smallest delay that at least fraction of the
+   sailings do not exceed. Delays under delay_exact_limit minutes are
+   exact; larger ones are the middle of their bucket, kept within the
+   smallest and largest delay seen. Returns 0 for an empty histogram. */
+long long delay_quantile(DelayHistogram const& histogram, double fraction)
+{
+    if (histogram.count == 0)
+        return 0;
+    const double wanted{ std::ceil(fraction * static_cast<double>(histogram.count)) };
+    const std::uint64_t rank{ std::max<std::uint64_t>(1, std::min(histogram.count, static_cast<std::uint64_t>(wanted))) };
+
+    std::uint64_t seen{ 0 };
+    long long value{ histogram.max_delay };
+    bool found{ false };
+    for (size_t b{ histogram.early.size() }; b-- > 0 && !found;)
+    {
+        seen += histogram.early[b];
+        if (seen >= rank)
+        {
+            value = -static_cast<long long>(delay_bucket_start(b) + (delay_bucket_width(b) - 1) / 2);
+            found = true;
+        }
+    }
+    for (size_t b{ 0 }; b < histogram.late.size() && !found; b++)
+    {
+        seen += histogram.late[b];
+        if (seen >= rank)
+        {
+            value = static_cast<long long>(delay_bucket_start(b) + (delay_bucket_width(b) - 1) / 2);
+            found = true;
+        }
+    }
+    return std::max(histogram.min_delay, std::min(histogram.max_delay, value));
+}
+
+/* Delay histograms for each route and each day, in first-seen order like
+   RouteAggregate and DayAggregate. */
+struct DelayAggregate
+{
+    std::vector<int> route_numbers{};
+    std::vector<DelayHistogram> route_delays{};
+    std::unordered_map<int, size_t> route_index{};
+    std::vector<Date> dates{};
+    std::vector<DelayHistogram> day_delays{};
+    std::unordered_map<Date, size_t, DateHash, DateEqual> day_index{};
+};
+
+DelayHistogram& route_delay_entry(DelayAggregate& aggregate, int route_number)
+{
+    const auto found{ aggregate.route_index.try_emplace(route_number, aggregate.route_numbers.size()) };
+    if (found.second)
+    {
+        aggregate.route_numbers.push_back(route_number);
+        aggregate.route_delays.emplace_back();
+    }
+    return aggregate.route_delays[found.first->second];
+}
+
+DelayHistogram& day_delay_entry(DelayAggregate& aggregate, const Date& date)
+{
+    const auto found{ aggregate.day_index.try_emplace(date, aggregate.dates.size()) };
+    if (found.second)
+    {
+        aggregate.dates.push_back(date);
+        aggregate.day_delays.emplace_back();
+    }
+    return aggregate.day_delays[found.first->second];
+}
+
+void add_delay_sailing(DelayAggregate& aggregate, int route_number, const Date& date, int expected_duration, int actual_duration)
+{
+    const long long delay{ static_cast<long long>(actual_duration) - expected_duration };
+    add_delay(route_delay_entry(aggregate, route_number), delay);
+    add_delay(day_delay_entry(aggregate, date), delay);
+}
+
+/* Add the histograms in from to into, appending routes and days that are
+   new to into in their order in from. */
+void merge_delay_aggregate(DelayAggregate& into, DelayAggregate const& from)
+{
+    for (size_t i{ 0 }; i < from.route_numbers.size(); i++)
+        merge_delay_histogram(route_delay_entry(into, from.route_numbers[i]), from.route_delays[i]);
+    for (size_t i{ 0 }; i < from.dates.size(); i++)
+        merge_delay_histogram(day_delay_entry(into, from.dates[i]), from.day_delays[i]);
+}
+
+/* aggregate_delays(sailings)
+   Build the route and day delay histograms in one pass, split across
+   worker threads the same way as performance_by_route; each worker fills
+   its own DelayAggregate and the results are merged in slice order. */
+template <typename SliceAggregator>
+DelayAggregate aggregate_delays_in_parallel(size_t count, SliceAggregator aggregate_slice)
+{
+    const size_t workers{ worker_count(count) };
+    std::vector<DelayAggregate> partials(workers);
+
+    const size_t slice{ (count + workers - 1) / workers };
+    run_workers(workers, [&aggregate_slice, &partials, count, slice](size_t w) {
+        const size_t begin{ std::min(count, w * slice) };
+        const size_t end{ std::min(count, begin + slice) };
+        aggregate_slice(begin, end, partials.at(w));
+    });
+
+    DelayAggregate total{ std::move(partials.at(0)) };
+    for (size_t w{ 1 }; w < workers; w++)
+        merge_delay_aggregate(total, partials.at(w));
+    return total;
+}
+
+DelayAggregate aggregate_delays(std::vector<Sailing> const& sailings)
+{
+    return aggregate_delays_in_parallel(sailings.size(), [&sailings](size_t begin, size_t end, DelayAggregate& aggregate) {
+        for (size_t i{ begin }; i < end; i++)
+            add_delay_sailing(aggregate, sailings[i].route_number, sailings[i].departure_date, sailings[i].expected_duration, sailings[i].actual_duration);
+    });
+}
+
+DelayAggregate aggregate_delays(SailingTable const& table)
+{
+    return aggregate_delays_in_parallel(table_size(table), [&table](size_t begin, size_t end, DelayAggregate& aggregate) {
+        for (size_t i{ begin }; i < end; i++)
+            add_delay_sailing(aggregate, table.route_number[i], Date{ table.day[i], table.month[i], table.year[i] }, table.expected_duration[i], table.actual_duration[i]);
+    });
+}
+
+/* Write the count, p50, p95, p99 and maximum of one histogram as the end
+   of a text, CSV or JSON Lines row. */
+void write_delay_percentiles(ReportWriter& writer, ReportFormat format, DelayHistogram const& delays)
+{
+    const long long p50{ delay_quantile(delays, 0.50) };
+    const long long p95{ delay_quantile(delays, 0.95) };
+    const long long p99{ delay_quantile(delays, 0.99) };
+    switch (format)
+    {
+    case ReportFormat::Text:
+        writer.integer(static_cast<long long>(delays.count)).text(" sailings, p50 ").integer(p50).text(", p95 ").integer(p95);
+        writer.text(", p99 ").integer(p99).text(", max ").integer(delays.max_delay);
+        break;
+    case ReportFormat::Csv:
+        writer.integer(static_cast<long long>(delays.count)).text(",").integer(p50).text(",").integer(p95);
+        writer.text(",").integer(p99).text(",").integer(delays.max_delay);
+        break;
+    case ReportFormat::JsonLines:
+        writer.text("\"total_sailings\":").integer(static_cast<long long>(delays.count)).text(",\"p50\":").integer(p50);
+        writer.text(",\"p95\":").integer(p95).text(",\"p99\":").integer(p99).text(",\"max\":").integer(delays.max_delay).text("}");
+        break;
+    }
+    writer.end_line();
+}
+
+/* Print the delay percentiles of each route, then of each day. CSV rows
+   have a "scope" column (route or day) and leave the fields of the other
+   scope empty. */
+void print_delay_report(ReportWriter& writer, ReportFormat format, DelayAggregate const& aggregate)
+{
+    if (format == ReportFormat::Csv)
+    {
+        writer.text("scope,route,year,month,day,total_sailings,p50,p95,p99,max");
+        writer.end_line();
+    }
+
+    write_heading(writer, format, "Delay percentiles by route (minutes):");
+    for (size_t i{ 0 }; i < aggregate.route_numbers.size(); i++)
+    {
+        if (format == ReportFormat::Text)
+            writer.text("Route ").integer(aggregate.route_numbers[i]).text(": ");
+        else if (format == ReportFormat::Csv)
+            writer.text("route,").integer(aggregate.route_numbers[i]).text(",,,,");
+        else
+            writer.text("{\"scope\":\"route\",\"route\":").integer(aggregate.route_numbers[i]).text(",");
+        write_delay_percentiles(writer, format, aggregate.route_delays[i]);
+    }
+
+    write_heading(writer, format, "Delay percentiles by day (minutes):");
+    for (size_t i{ 0 }; i < aggregate.dates.size(); i++)
+    {
+        const Date& date{ aggregate.dates[i] };
+        if (format == ReportFormat::Text)
+            writer.integer(date.year).text("-").integer(date.month).text("-").integer(date.day).text(": ");
+        else if (format == ReportFormat::Csv)
+            writer.text("day,,").integer(date.year).text(",").integer(date.month).text(",").integer(date.day).text(",");
+        else
+            writer.text("{\"scope\":\"day\",\"year\":").integer(date.year).text(",\"month\":").integer(date.month).text(",\"day\":").integer(date.day).text(",");
+        write_delay_percentiles(writer, format, aggregate.day_delays[i]);
+    }
+}
+
+template <typename Sailings>
+void print_delay_report(ReportWriter& writer, ReportFormat format, Sailings const& sailings)
+{
+    print_delay_report(writer, format, aggregate_delays(sailings));
+}
+
+void print_delay_report(ReportWriter& writer, ReportFormat, StreamingAggregate const&)
+{
+    writer.text("The delays action needs stored sailings; it is not available with --storage=none or --checkpoint.");
+    writer.end_line();
+}
+
+/* Rolling trends
+   The trends action reports, for each route and each day it sailed, the
+   sailings and late sailings in the trend_windows calendar days ending on
+   that day, and their late ratio. Sailings are bucketed by route and day
+   number in one pass; the buckets are then put in route and date order
+   and each route's series is written in a single sweep. Every window
+   keeps running totals that gain the day entering it and lose the days
+   falling out of it, so each day costs O(1) per window however long the
+   history is. Routes come in first-seen order, as in route_summary. Dates
+   that are not calendar dates have no day number and are left out. */
+const int trend_windows[]{ 7, 30 };
+const size_t trend_window_count{ sizeof(trend_windows) / sizeof(trend_windows[0]) };
+
+/* The sailings of one route on one day. route_rank is the position of the
+   route in first-seen order. */
+struct TrendBucket
+{
+    size_t route_rank{ 0 };
+    int route_number{ 0 };
+    DayNumber day{ 0 };
+    int total_sailings{ 0 };
+    int late_sailings{ 0 };
+};
+
+/* Route and day buckets in first-seen order, found through index by route
+   number (high 32 bits) and day number (low 32 bits). */
+struct TrendAggregate
+{
+    std::vector<TrendBucket> buckets{};
+    std::unordered_map<std::uint64_t, size_t> index{};
+    std::unordered_map<int, size_t> route_ranks{};
+};
+
+/* Running totals of one window over the days of one route; oldest is the
+   first bucket still inside it. */
+struct RollingWindow
+{
+    long long total_sailings{ 0 };
+    long long late_sailings{ 0 };
+    size_t oldest{ 0 };
+};
+
+void add_trend_sailing(TrendAggregate& aggregate, int route_number, const Date& date, bool late)
+{
+    /* Routes are ranked even by sailings that are left out, so that their
+       order matches route_summary. */
+    const auto rank{ aggregate.route_ranks.try_emplace(route_number, aggregate.route_ranks.size()) };
+    if (!has_day_number(date))
+        return;
+    const DayNumber day{ to_day_number(date) };
+    const std::uint64_t key{ (static_cast<std::uint64_t>(static_cast<std::uint32_t>(route_number)) << 32) | static_cast<std::uint32_t>(day) };
+    const auto found{ aggregate.index.try_emplace(key, aggregate.buckets.size()) };
+    if (found.second)
+        aggregate.buckets.push_back(TrendBucket{ rank.first->second, route_number, day, 0, 0 });
+    TrendBucket& bucket{ aggregate.buckets[found.first->second] };
+    bucket.total_sailings++;
+    if (late)
+        bucket.late_sailings++;
+}
+
+TrendAggregate aggregate_trends(std::vector<Sailing> const& sailings)
+{
+    TrendAggregate aggregate{};
+    for (const Sailing& sailing : sailings)
+        add_trend_sailing(aggregate, sailing.route_number, sailing.departure_date, is_late_sailing(sailing.expected_duration, sailing.actual_duration));
+    return aggregate;
+}
+
+TrendAggregate aggregate_trends(SailingTable const& table)
+{
+    TrendAggregate aggregate{};
+    for (size_t i{ 0 }; i < table_size(table); i++)
+        add_trend_sailing(aggregate, table.route_number[i], Date{ table.day[i], table.month[i], table.year[i] },
+                          is_late_sailing(table.expected_duration[i], table.actual_duration[i]));
+    return aggregate;
+}
+
+void write_trend_header(ReportWriter& writer, ReportFormat format)
+{
+    if (format == ReportFormat::Csv)
+    {
+        writer.text("route,year,month,day,total_sailings,late_sailings");
+        for (int days : trend_windows)
+        {
+            writer.text(",total_").integer(days).text("d,late_").integer(days).text("d,late_ratio_").integer(days).text("d");
+        }
+        writer.end_line();
+    }
+}
+
+/* Write one day of a route's series: the day's own totals, then those of
+   each window ending on it. */
+void write_trend_row(ReportWriter& writer, ReportFormat format, TrendBucket const& bucket, std::array<RollingWindow, trend_window_count> const& windows)
+{
+    const Date date{ from_day_number(bucket.day) };
+    switch (format)
+    {
+    case ReportFormat::Text:
+        writer.text("Route ").integer(bucket.route_number).text(" ").integer(date.year).text("-").integer(date.month).text("-").integer(date.day);
+        writer.text(": ").integer(bucket.total_sailings).text(" sailings (").integer(bucket.late_sailings).text(" late)");
+        for (size_t w{ 0 }; w < trend_window_count; w++)
+        {
+            writer.text(", ").integer(trend_windows[w]).text(" days: ").integer(windows[w].total_sailings).text(" sailings (");
+            writer.integer(windows[w].late_sailings).text(" late, ");
+            writer.fixed(100.0 * static_cast<double>(windows[w].late_sailings) / static_cast<double>(windows[w].total_sailings), 1).text("%)");
+        }
+        break;
+    case ReportFormat::Csv:
+        writer.integer(bucket.route_number).text(",").integer(date.year).text(",").integer(date.month).text(",").integer(date.day);
+        writer.text(",").integer(bucket.total_sailings).text(",").integer(bucket.late_sailings);
+        for (const RollingWindow& window : windows)
+        {
+            writer.text(",").integer(window.total_sailings).text(",").integer(window.late_sailings).text(",");
+            writer.fixed(static_cast<double>(window.late_sailings) / static_cast<double>(window.total_sailings), 4);
+        }
+        break;
+    case ReportFormat::JsonLines:
+        writer.text("{\"route\":").integer(bucket.route_number).text(",\"year\":").integer(date.year);
+        writer.text(",\"month\":").integer(date.month).text(",\"day\":").integer(date.day);
+        writer.text(",\"total_sailings\":").integer(bucket.total_sailings).text(",\"late_sailings\":").integer(bucket.late_sailings);
+        for (size_t w{ 0 }; w < trend_window_count; w++)
+        {
+            writer.text(",\"total_").integer(trend_windows[w]).text("d\":").integer(windows[w].total_sailings);
+            writer.text(",\"late_").integer(trend_windows[w]).text("d\":").integer(windows[w].late_sailings);
+            writer.text(",\"late_ratio_").integer(trend_windows[w]).text("d\":");
+            writer.fixed(static_cast<double>(windows[w].late_sailings) / static_cast<double>(windows[w].total_sailings), 4);
+        }
+        writer.text("}");
+        break;
+    }
+    writer.end_line();
+}
+
+/* print_trend_report(writer, format, aggregate)
+   Sort the buckets of aggregate by route and date, radix-sorting on the
+   route rank (high 32 bits) and day number (low 32 bits) as
+   chronological_order does, and write every route's series (see above).
+   A window always holds the current day, so its totals are never zero. */
+void print_trend_report(ReportWriter& writer, ReportFormat format, TrendAggregate&& aggregate)
+{
+    std::vector<std::uint64_t> keys{};
+    std::vector<size_t> order{};
+    for (size_t i{ 0 }; i < aggregate.buckets.size(); i++)
+    {
+        const TrendBucket& bucket{ aggregate.buckets[i] };
+        keys.push_back((static_cast<std::uint64_t>(bucket.route_rank) << 32) | (static_cast<std::uint32_t>(bucket.day) ^ 0x80000000u));
+        order.push_back(i);
+    }
+    radix_sort_order(keys, order);
+    std::vector<TrendBucket> buckets{};
+    buckets.reserve(order.size());
+    for (size_t i : order)
+        buckets.push_back(aggregate.buckets[i]);
+    aggregate = TrendAggregate{};
+
+    write_trend_header(writer, format);
+    write_heading(writer, format, "Rolling late sailings by route:");
+    std::array<RollingWindow, trend_window_count> windows{};
+    for (size_t i{ 0 }; i < buckets.size(); i++)
+    {
+        if (i == 0 || buckets[i].route_rank != buckets[i - 1].route_rank)
+            windows.fill(RollingWindow{ 0, 0, i });
+        for (size_t w{ 0 }; w < trend_window_count; w++)
+        {
+            RollingWindow& window{ windows[w] };
+            window.total_sailings += buckets[i].total_sailings;
+            window.late_sailings += buckets[i].late_sailings;
+            while (buckets[window.oldest].day <= buckets[i].day - trend_windows[w])
+            {
+                window.total_sailings -= buckets[window.oldest].total_sailings;
+                window.late_sailings -= buckets[window.oldest].late_sailings;
+                window.oldest++;
+            }
+        }
+        write_trend_row(writer, format, buckets[i], windows);
+    }
+}
+
+template <typename Sailings>
+void print_trend_report(ReportWriter& writer, ReportFormat format, Sailings const& sailings)
+{
+    print_trend_report(writer, format, aggregate_trends(sailings));
+}
+
+void print_trend_report(ReportWriter& writer, ReportFormat, StreamingAggregate const&)
+{
+    writer.text("The trends action needs stored sailings; it is not available with --storage=none or --checkpoint.");
+    writer.end_line();
+}
+
+/* Sharded aggregation
+   The shard action runs one worker of a job split across N processes,
+   possibly on different machines that share a filesystem. Worker K of N
+   (--shard=K/N, with K counted from 0) takes
+
+     a single file          the lines that start in bytes
+                            [K * size / N, (K + 1) * size / N) of it
+     a directory/pattern    files [K * F / N, (K + 1) * F / N) of the F
+                            files, in name order
+
+   and writes a partial aggregate of them: the line counts, the route and
+   day totals, and the delay histogram of every route and day. Every input
+   line belongs to exactly one shard and no shard depends on another, so a
+   worker that failed can simply be run again. Given partial aggregates as
+   input (one file, or a pattern matching all N of them), the report
+   actions merge them in shard order, which puts routes and days in the
+   same first-seen order a single pass would. As with --storage=none every
+   line is counted, so sailings repeated in several files of a directory
+   are not dropped.
+
+   Partial aggregate layout (LEB128 varints, as in archives):
+
+     partial_magic, version
+     shard index, shard count, input kind (0 = byte range, 1 = files)
+     input name (length + bytes), input file count, input byte count
+     valid sailings, total lines
+     per kind of error: lines, the error_field_slots field counts, and the
+       sample line numbers (count, then each, from the shard's first line)
+     invalid-line count, then per line: line number (from the shard's
+       first line), kind (a ParseErrorKind), fields found, field index,
+       bad field (length + bytes), and the zigzag hour and minute of a bad
+       time
+     route count, then per route: zigzag route number, total, late, delays
+     day count, then per day: zigzag year, month and day, total, late,
+       delays
+
+   where delays is a DelayHistogram: count, zigzag minimum and maximum
+   delay, then the early and the late bucket counts (length, then each). */
+const char partial_magic[8]{ 'S', 'A', 'I', 'L', 'P', 'A', 'R', 'T' };
+const std::uint64_t partial_version{ 3 };
+
+/* ShardAggregate
+   The sink a shard loads into, and the result of merging shards. Unlike
+   StreamingAggregate it keeps delay histograms, so the delays report is
+   available too. */
+struct ShardAggregate
+{
+    StreamingAggregate totals{};
+    DelayAggregate delays{};
+    LoadCounts counts{};
+};
+
+/* One partial aggregate file: the shard it holds and the input it was cut
+   from. */
+struct PartialAggregate
+{
+    std::uint64_t shard_index{ 0 };
+    std::uint64_t shard_count{ 0 };
+    std::uint64_t input_kind{ 0 };
+    std::string input_name{};
+    std::uint64_t input_files{ 0 };
+    std::uint64_t input_bytes{ 0 };
+    ShardAggregate aggregate{};
+    std::vector<InvalidLine> invalid_lines{};
+};
+
+void append_sailing(ShardAggregate& aggregate, const SailingView& view)
+{
+    append_sailing(aggregate.totals, view);
+    add_delay_sailing(aggregate.delays, view.route_number, view.departure_date, view.expected_duration, view.actual_duration);
+}
+
+void reserve_sailings(ShardAggregate&, size_t)
+{
+}
+
+std::vector<RouteStatistics> performance_by_route(ShardAggregate const& aggregate)
+{
+    return aggregate.totals.routes.routes;
+}
+
+DayAggregate aggregate_days(ShardAggregate const& aggregate)
+{
+    return aggregate.totals.days;
+}
+
+void print_delay_report(ReportWriter& writer, ReportFormat format, ShardAggregate const& aggregate)
+{
+    print_delay_report(writer, format, aggregate.delays);
+}
+
+void print_group_report(ReportWriter& writer, ReportFormat, std::vector<GroupDimension> const&, ShardAggregate const&)
+{
+    writer.text("The group_by action needs stored sailings; it is not available for partial aggregates.");
+    writer.end_line();
+}
+
+void print_trend_report(ReportWriter& writer, ReportFormat, ShardAggregate const&)
+{
+    writer.text("The trends action needs stored sailings; it is not available for partial aggregates.");
+    writer.end_line();
+}
+
+void write_sailings(ReportWriter& writer, ReportFormat, ShardAggregate const&)
+{
+    writer.text("The sailings action needs stored sailings; it is not available for partial aggregates.");
+    writer.end_line();
+}
+
+/* Parse --shard=K/N. */
+bool parse_shard_option(std::string const& text, int& index, int& count)
+{
+    const size_t slash{ text.find('/') };
+    return slash != std::string::npos && parse_int_option(std::string_view{ text }.substr(0, slash), index)
+        && parse_int_option(std::string_view{ text }.substr(slash + 1), count) && count >= 1 && index >= 0 && index < count;
+}
+
+/* The lines of contents that start in the index-th of count equal byte
+   ranges. A line starts at offset 0 or just after a newline. */
+std::string_view shard_range(std::string_view contents, std::uint64_t index, std::uint64_t count)
+{
+    const auto line_start{ [contents, count](std::uint64_t part) {
+        const size_t offset{ static_cast<size_t>(contents.size() * part / count) };
+        if (offset == 0 || offset >= contents.size())
+            return offset;
+        const size_t newline{ contents.find('\n', offset - 1) };
+        return newline == std::string_view::npos ? contents.size() : newline + 1;
+    } };
+    const size_t begin{ line_start(index) };
+    return contents.substr(begin, line_start(index + 1) - begin);
+}
+
+void write_delay_histogram(std::string& output, DelayHistogram const& histogram)
+{
+    write_varint(output, histogram.count);
+    write_varint(output, zigzag_encode(histogram.min_delay));
+    write_varint(output, zigzag_encode(histogram.max_delay));
+    for (const std::vector<std::uint32_t>* side : { &histogram.early, &histogram.late })
+    {
+        write_varint(output, side->size());
+        for (std::uint32_t bucket : *side)
+            write_varint(output, bucket);
+    }
+}
+
+/* Read what write_delay_histogram wrote. Buckets that do not add up to the
+   count mark reader as failed. */
+void read_delay_histogram(BinaryReader& reader, DelayHistogram& histogram)
+{
+    histogram.count = read_varint(reader);
+    histogram.min_delay = zigzag_decode(read_varint(reader));
+    histogram.max_delay = zigzag_decode(read_varint(reader));
+    std::uint64_t bucket_total{ 0 };
+    for (std::vector<std::uint32_t>* side : { &histogram.early, &histogram.late })
+    {
+        const std::uint64_t size{ read_varint(reader) };
+        if (size > delay_bucket_limit)
+            reader.ok = false;
+        side->assign(reader.ok ? static_cast<size_t>(size) : 0, 0);
+        for (std::uint32_t& bucket : *side)
+        {
+            const std::uint64_t value{ read_varint(reader) };
+            bucket = static_cast<std::uint32_t>(value);
+            bucket_total += bucket;
+            if (value > UINT32_MAX)
+                reader.ok = false;
+        }
+    }
+    if (bucket_total != histogram.count)
+        reader.ok = false;
+}
+
+void write_load_counts(std::string& output, LoadCounts const& counts)
+{
+    write_varint(output, static_cast<std::uint64_t>(counts.valid_sailings));
+    write_varint(output, static_cast<std::uint64_t>(counts.total_lines));
+    for (size_t kind{ 0 }; kind < parse_error_kinds; kind++)
+    {
+        write_varint(output, static_cast<std::uint64_t>(counts.errors.lines[kind]));
+        for (std::int64_t lines : counts.errors.fields[kind])
+            write_varint(output, static_cast<std::uint64_t>(lines));
+        write_varint(output, counts.errors.samples[kind].size());
+        for (int line_number : counts.errors.samples[kind])
+            write_varint(output, static_cast<std::uint64_t>(line_number));
+    }
+}
+
+void read_load_counts(BinaryReader& reader, LoadCounts& counts)
+{
+    const std::uint64_t valid_sailings{ read_varint(reader) };
+    const std::uint64_t total_lines{ read_varint(reader) };
+    if (valid_sailings > total_lines || total_lines > INT_MAX)
+        reader.ok = false;
+    counts.valid_sailings = static_cast<int>(valid_sailings);
+    counts.total_lines = static_cast<int>(total_lines);
+    for (size_t kind{ 0 }; kind < parse_error_kinds && reader.ok; kind++)
+    {
+        counts.errors.lines[kind] = static_cast<std::int64_t>(read_varint(reader));
+        for (std::int64_t& lines : counts.errors.fields[kind])
+            lines = static_cast<std::int64_t>(read_varint(reader));
+        const std::uint64_t samples{ read_varint(reader) };
+        for (std::uint64_t i{ 0 }; i < samples && reader.ok; i++)
+        {
+            const std::uint64_t line_number{ read_varint(reader) };
+            if (line_number == 0 || line_number > total_lines)
+                reader.ok = false;
+            counts.errors.samples[kind].push_back(static_cast<int>(line_number));
+        }
+    }
+}
+
+/* write_partial_aggregate(filename, partial)
+   Write partial to filename (see above), under a temporary name that is
+   renamed into place, so a worker that dies leaves no partial file behind.
+   Returns false if it could not be written. */
+bool write_partial_aggregate(std::string const& filename, PartialAggregate const& partial)
+{
+    const ShardAggregate& aggregate{ partial.aggregate };
+    std::string output{ partial_magic, sizeof(partial_magic) };
+    write_varint(output, partial_version);
+    write_varint(output, partial.shard_index);
+    write_varint(output, partial.shard_count);
+    write_varint(output, partial.input_kind);
+    write_varint(output, partial.input_name.size());
+    output += partial.input_name;
+    write_varint(output, partial.input_files);
+    write_varint(output, partial.input_bytes);
+    write_load_counts(output, aggregate.counts);
+    write_varint(output, partial.invalid_lines.size());
+    for (const InvalidLine& line : partial.invalid_lines)
+    {
+        write_varint(output, static_cast<std::uint64_t>(line.line_number));
+        write_varint(output, static_cast<std::uint64_t>(line.error.kind));
+        write_varint(output, line.error.num_fields);
+        write_varint(output, line.error.which_field);
+        write_varint(output, line.bad_field.size());
+        output += line.bad_field;
+        write_varint(output, zigzag_encode(line.error.bad_time.hour));
+        write_varint(output, zigzag_encode(line.error.bad_time.minute));
+    }
+
+    write_varint(output, aggregate.totals.routes.routes.size());
+    for (const RouteStatistics& stats : aggregate.totals.routes.routes)
+    {
+        write_varint(output, zigzag_encode(stats.route_number));
+        write_varint(output, static_cast<std::uint64_t>(stats.total_sailings));
+        write_varint(output, static_cast<std::uint64_t>(stats.late_sailings));
+        write_delay_histogram(output, aggregate.delays.route_delays[aggregate.delays.route_index.at(stats.route_number)]);
+    }
+    write_varint(output, aggregate.totals.days.days.size());
+    for (const DayStatistics& stats : aggregate.totals.days.days)
+    {
+        write_varint(output, zigzag_encode(stats.date.year));
+        write_varint(output, zigzag_encode(stats.date.month));
+        write_varint(output, zigzag_encode(stats.date.day));
+        write_varint(output, static_cast<std::uint64_t>(stats.total_sailings));
+        write_varint(output, static_cast<std::uint64_t>(stats.late_sailings));
+        write_delay_histogram(output, aggregate.delays.day_delays[aggregate.delays.day_index.at(stats.date)]);
+    }
+
+    const std::string temporary_filename{ temporary_filename_for(filename) };
+    {
+        std::ofstream file{ temporary_filename, std::ios::binary | std::ios::trunc };
+        if (!file.is_open())
+            return false;
+        file.write(output.data(), static_cast<std::streamsize>(output.size()));
+        if (!file.good())
+        {
+            file.close();
+            std::filesystem::remove(temporary_filename);
+            return false;
+        }
+    }
+    return rename_into_place(temporary_filename, filename);
+}
+
+/* True if filename starts with partial_magic. */
+bool is_partial_aggregate(std::string const& filename)
+{
+    std::ifstream input_file{ filename, std::ios::binary };
+    char magic[sizeof(partial_magic)]{};
+    return input_file.read(magic, sizeof(magic)) && std::memcmp(magic, partial_magic, sizeof(magic)) == 0;
+}
+
+/* True if input_filename is a partial aggregate, or a pattern whose first
+   file is one. */
+bool is_partial_aggregate_input(std::string const& input_filename)
+{
+    if (!is_multi_file_input(input_filename))
+        return is_partial_aggregate(input_filename);
+    const std::vector<std::string> files{ expand_input_files(input_filename) };
+    return !files.empty() && is_partial_aggregate(files.front());
+}
+
+/* Read the totals and delay histogram of one route or day. They must agree
+   with each other and fit the int counters. */
+void read_partial_totals(BinaryReader& reader, int& total_sailings, int& late_sailings, DelayHistogram& delays)
+{
+    const std::uint64_t total{ read_varint(reader) };
+    const std::uint64_t late{ read_varint(reader) };
+    read_delay_histogram(reader, delays);
+    if (total > INT_MAX || late > total || delays.count != total)
+        reader.ok = false;
+    total_sailings = static_cast<int>(total);
+    late_sailings = static_cast<int>(late);
+}
+
+/* Fill partial from filename. Returns false if it is not a valid partial
+   aggregate. */
+bool read_partial_aggregate(std::string const& filename, PartialAggregate& partial)
+{
+    const MappedFile file{ filename };
+    BinaryReader reader{ file.contents() };
+    char magic[sizeof(partial_magic)]{};
+    if (!read_binary(reader, magic, sizeof(magic)) || std::memcmp(magic, partial_magic, sizeof(magic)) != 0
+        || read_varint(reader) != partial_version)
+        return false;
+
+    partial = PartialAggregate{};
+    partial.shard_index = read_varint(reader);
+    partial.shard_count = read_varint(reader);
+    partial.input_kind = read_varint(reader);
+    const std::uint64_t name_length{ read_varint(reader) };
+    if (!reader.ok || reader.data.size() - reader.position < name_length)
+        return false;
+    partial.input_name = std::string{ reader.data.substr(reader.position, static_cast<size_t>(name_length)) };
+    reader.position += static_cast<size_t>(name_length);
+    partial.input_files = read_varint(reader);
+    partial.input_bytes = read_varint(reader);
+
+    ShardAggregate& aggregate{ partial.aggregate };
+    read_load_counts(reader, aggregate.counts);
+    const std::uint64_t invalid_count{ read_varint(reader) };
+    for (std::uint64_t i{ 0 }; i < invalid_count && reader.ok; i++)
+    {
+        const std::uint64_t line_number{ read_varint(reader) };
+        const std::uint64_t kind{ read_varint(reader) };
+        const std::uint64_t num_fields{ read_varint(reader) };
+        const std::uint64_t which_field{ read_varint(reader) };
+        const std::uint64_t length{ read_varint(reader) };
+        if (!reader.ok || line_number == 0 || line_number > static_cast<std::uint64_t>(aggregate.counts.total_lines)
+            || kind == 0 || kind >= parse_error_kinds || num_fields > UINT_MAX || which_field > UINT_MAX
+            || reader.data.size() - reader.position < length)
+            return false;
+        InvalidLine line{ static_cast<int>(line_number), ParseError{ static_cast<ParseErrorKind>(kind), static_cast<unsigned int>(num_fields),
+                                                                     static_cast<unsigned int>(which_field) } };
+        line.bad_field = std::string{ reader.data.substr(reader.position, static_cast<size_t>(length)) };
+        reader.position += static_cast<size_t>(length);
+        line.error.bad_time.hour = static_cast<int>(zigzag_decode(read_varint(reader)));
+        line.error.bad_time.minute = static_cast<int>(zigzag_decode(read_varint(reader)));
+        partial.invalid_lines.push_back(std::move(line));
+    }
+    const std::uint64_t route_count{ read_varint(reader) };
+    for (std::uint64_t i{ 0 }; i < route_count && reader.ok; i++)
+    {
+        const int route_number{ static_cast<int>(zigzag_decode(read_varint(reader))) };
+        RouteStatistics& stats{ route_entry(aggregate.totals.routes, route_number) };
+        DelayHistogram& delays{ route_delay_entry(aggregate.delays, route_number) };
+        read_partial_totals(reader, stats.total_sailings, stats.late_sailings, delays);
+    }
+    const std::uint64_t day_count{ read_varint(reader) };
+    for (std::uint64_t i{ 0 }; i < day_count && reader.ok; i++)
+    {
+        const int year{ static_cast<int>(zigzag_decode(read_varint(reader))) };
+        const int month{ static_cast<int>(zigzag_decode(read_varint(reader))) };
+        const Date date{ static_cast<int>(zigzag_decode(read_varint(reader))), month, year };
+        DayStatistics& stats{ day_entry(aggregate.totals.days, date) };
+        DelayHistogram& delays{ day_delay_entry(aggregate.delays, date) };
+        read_partial_totals(reader, stats.total_sailings, stats.late_sailings, delays);
+    }
+
+    /* A route or day listed twice would have been folded into one entry. */
+    return reader.ok && reader.position == reader.data.size() && partial.shard_index < partial.shard_count
+        && partial.input_kind <= 1 && aggregate.totals.routes.routes.size() == route_count
+        && aggregate.totals.days.days.size() == day_count;
+}
+
+/* run_shard(options)
+   The shard action: aggregate shard options.shard_index of
+   options.shard_count of options.input_filename (see above) and write it
+   to options.output, or input_filename + ".part-K-of-N". Invalid lines of
+   a file shard are reported as a full load would, with their line numbers
+   in their file, and their sample lines (with --errors=summary) count
+   through the shard's files in order. A byte range is read on its own and
+   numbers its lines from its start, so its invalid lines (or its sample
+   lines) are stored in the partial for the merge to renumber and report.
+   Returns false if the partial aggregate could not be written. */
+bool run_shard(DriverOptions const& options)
+{
+    std::ostream& report{ diagnostic_stream(options) };
+    const LoadReport shard_report{ load_report(options) };
+    PartialAggregate partial{};
+    partial.shard_index = static_cast<std::uint64_t>(options.shard_index);
+    partial.shard_count = static_cast<std::uint64_t>(options.shard_count);
+    partial.input_name = options.input_filename;
+    ShardAggregate& aggregate{ partial.aggregate };
+
+    if (is_multi_file_input(options.input_filename))
+    {
+        const std::vector<std::string> files{ expand_input_files(options.input_filename) };
+        if (files.empty())
+            throw std::runtime_error("No input files found");
+        partial.input_kind = 1;
+        partial.input_files = files.size();
+        for (const std::string& file : files)
+            partial.input_bytes += std::filesystem::file_size(file);
+
+        const size_t first{ static_cast<size_t>(files.size() * partial.shard_index / partial.shard_count) };
+        const size_t end{ static_cast<size_t>(files.size() * (partial.shard_index + 1) / partial.shard_count) };
+        for (size_t f{ first }; f < end; f++)
+        {
+            report << "Reading " << files[f] << std::endl;
+            const MappedFile input_file{ files[f] };
+            LoadCounts counts{ load_sailing_text(input_file.contents(), 1, aggregate, shard_report) };
+            print_load_summary(counts, shard_report);
+            for (std::vector<int>& samples : counts.errors.samples)
+            {
+                for (int& line_number : samples)
+                    line_number += aggregate.counts.total_lines;
+            }
+            add_load_counts(aggregate.counts, counts, shard_report.samples);
+        }
+    }
+    else
+    {
+        const MappedFile input_file{ options.input_filename };
+        const std::string_view contents{ input_file.contents() };
+        partial.input_files = 1;
+        partial.input_bytes = contents.size();
+        const std::string_view range{ shard_range(contents, partial.shard_index, partial.shard_count) };
+        LoadReport range_report{ shard_report };
+        range_report.kept_lines = &partial.invalid_lines;
+        aggregate.counts = load_sailing_text(range, 1, aggregate, range_report);
+    }
+    print_load_summary(aggregate.counts.valid_sailings, aggregate.counts.total_lines, report);
+
+    const std::string output_filename{ options.output.empty()
+        ? options.input_filename + ".part-" + std::to_string(options.shard_index) + "-of-" + std::to_string(options.shard_count)
+        : options.output };
+    if (!write_partial_aggregate(output_filename, partial))
+    {
+        std::cout << "Unable to write partial aggregate " << output_filename << std::endl;
+        return false;
+    }
+    report << "Wrote shard " << options.shard_index << " of " << options.shard_count << " to " << output_filename << " ("
+           << aggregate.totals.routes.routes.size() << " routes, " << aggregate.totals.days.days.size() << " days)." << std::endl;
+    return true;
+}
+
+/* merge_partial_aggregates(options, merged)
+   Read the partial aggregates options.input_filename refers to and merge
+   them into merged in shard order. The invalid lines and sample lines the
+   shards kept are renumbered from the start of the input, and reported
+   with the load totals as a single load would. Returns false, after saying
+   why, unless the files are all N shards of one run, each exactly once. */
+bool merge_partial_aggregates(DriverOptions const& options, ShardAggregate& merged)
+{
+    const std::vector<std::string> files{ is_multi_file_input(options.input_filename) ? expand_input_files(options.input_filename)
+                                                                                      : std::vector<std::string>{ options.input_filename } };
+    if (files.empty())
+    {
+        std::cout << "No partial aggregates found." << std::endl;
+        return false;
+    }
+    std::vector<PartialAggregate> shards(files.size());
+    for (size_t f{ 0 }; f < files.size(); f++)
+    {
+        const PartialAggregate& first{ shards.front() };
+        PartialAggregate& shard{ shards[f] };
+        if (!read_partial_aggregate(files[f], shard))
+        {
+            std::cout << files[f] << " is not a valid partial aggregate." << std::endl;
+            return false;
+        }
+        if (f > 0 && (shard.shard_count != first.shard_count || shard.input_kind != first.input_kind
+                      || shard.input_files != first.input_files || shard.input_bytes != first.input_bytes))
+        {
+            std::cout << files[f] << " is a shard of a different input or run than " << files.front() << "." << std::endl;
+            return false;
+        }
+    }
+
+    std::vector<size_t> order(files.size());
+    std::iota(order.begin(), order.end(), size_t{ 0 });
+    std::sort(order.begin(), order.end(), [&shards](size_t a, size_t b) { return shards[a].shard_index < shards[b].shard_index; });
+    for (size_t i{ 1 }; i < order.size(); i++)
+    {
+        if (shards[order[i]].shard_index == shards[order[i - 1]].shard_index)
+        {
+            std::cout << "Shard " << shards[order[i]].shard_index << " is in both " << files[order[i - 1]] << " and " << files[order[i]] << "." << std::endl;
+            return false;
+        }
+    }
+    const std::uint64_t shard_count{ shards.front().shard_count };
+    if (shards.size() != shard_count)
+    {
+        std::cout << "Missing shards";
+        const char* separator{ " " };
+        size_t next{ 0 };
+        for (std::uint64_t index{ 0 }; index < shard_count; index++)
+        {
+            if (next < order.size() && shards[order[next]].shard_index == index)
+            {
+                next++;
+                continue;
+            }
+            std::cout << separator << index;
+            separator = ", ";
+        }
+        std::cout << " of " << shard_count << "." << std::endl;
+        return false;
+    }
+
+    const LoadReport report{ load_report(options) };
+    report.stream << "Merged " << shard_count << " shards of " << shards.front().input_name << "." << std::endl;
+    for (size_t index : order)
+    {
+        LoadCounts& counts{ shards[index].aggregate.counts };
+        for (const InvalidLine& line : shards[index].invalid_lines)
+        {
+            ParseError error{ line.error };
+            error.bad_field = line.bad_field;
+            report_invalid_line(error, merged.counts.total_lines + line.line_number, report.stream);
+        }
+        for (std::vector<int>& samples : counts.errors.samples)
+        {
+            for (int& line_number : samples)
+                line_number += merged.counts.total_lines;
+        }
+        add_load_counts(merged.counts, counts, report.samples);
+        merge_route_aggregate(merged.totals.routes, shards[index].aggregate.totals.routes);
+        merge_day_aggregate(merged.totals.days, shards[index].aggregate.totals.days);
+        merge_delay_aggregate(merged.delays, shards[index].aggregate.delays);
+        shards[index] = PartialAggregate{};
+    }
+    print_load_summary(merged.counts, report);
+    return true;
+}
+
+/* Tail mode
+   A TailCheckpoint records how much of an append-only input file has been
+   folded into a StreamingAggregate: the byte offset just past the last
+   complete line consumed, the line counts and error tally so far, and a
+   fingerprint of the start of the file. Each refresh maps the file and parses only the bytes
+   after offset, up to the last newline (a line still being written is left
+   for the next refresh). If the file is now shorter than offset, or its
+   first bytes no longer match the fingerprint, it has been replaced and the
+   aggregate is rebuilt from the beginning.
+
+   Checkpoint file layout (host byte order, like snapshots):
+     CheckpointHeader
+     the RouteStatistics of the aggregate, as a raw array
+     the DayStatistics of the aggregate, as a raw array
+     the line counts, error tally and sample line numbers, as in partial
+       aggregates (see "Sharded aggregation") */
+const char checkpoint_magic[8]{ 'S', 'A', 'I', 'L', 'T', 'A', 'I', 'L' };
+const std::uint32_t checkpoint_version{ 2 };
+const size_t fingerprint_bytes{ 4096 };
+
+struct CheckpointHeader
+{
+    char magic[8]{};
+    std::uint32_t version{ 0 };
+    std::uint32_t byte_order{ 0 };
+    std::uint64_t offset{ 0 };
+    std::uint64_t fingerprint{ 0 };
+    std::int64_t valid_sailings{ 0 };
+    std::int64_t total_lines{ 0 };
+    std::uint64_t route_count{ 0 };
+    std::uint64_t day_count{ 0 };
+};
+static_assert(sizeof(CheckpointHeader) == 64, "CheckpointHeader must not contain padding");
+
+struct TailCheckpoint
+{
+    std::uint64_t offset{ 0 };
+    std::uint64_t fingerprint{ 0 };
+    LoadCounts counts{};
+    StreamingAggregate aggregate{};
+};
+
+/* FNV-1a hash of the first min(length, fingerprint_bytes) bytes of contents. */
+std::uint64_t fingerprint_prefix(std::string_view contents, std::uint64_t length)
+{
+    const size_t size{ static_cast<size_t>(std::min<std::uint64_t>({ length, contents.size(), fingerprint_bytes })) };
+    std::uint64_t hash{ 14695981039346656037ull };
+    for (size_t i{ 0 }; i < size; i++)
+    {
+        hash ^= static_cast<unsigned char>(contents[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/* Fill checkpoint from filename. Returns false, leaving checkpoint empty, if
+   the file does not exist or is not a valid checkpoint. */
+bool load_checkpoint(std::string const& filename, TailCheckpoint& checkpoint)
+{
+    checkpoint = TailCheckpoint{};
+    std::error_code error{};
+    if (!std::filesystem::is_regular_file(filename, error))
+        return false;
+
+    const MappedFile file{ filename };
+    BinaryReader reader{ file.contents() };
+
+    CheckpointHeader header{};
+    if (!read_binary(reader, &header, sizeof(header))
+        || std::memcmp(header.magic, checkpoint_magic, sizeof(checkpoint_magic)) != 0
+        || header.version != checkpoint_version
+        || header.byte_order != snapshot_byte_order)
+        return false;
+
+    RouteAggregate routes{};
+    DayAggregate days{};
+    read_binary_column(reader, routes.routes, static_cast<size_t>(header.route_count));
+    read_binary_column(reader, days.days, static_cast<size_t>(header.day_count));
+    LoadCounts counts{};
+    read_load_counts(reader, counts);
+    if (!reader.ok || reader.position != reader.data.size()
+        || counts.valid_sailings != header.valid_sailings || counts.total_lines != header.total_lines)
+        return false;
+
+    checkpoint.offset = header.offset;
+    checkpoint.fingerprint = header.fingerprint;
+    checkpoint.counts = std::move(counts);
+    merge_route_aggregate(checkpoint.aggregate.routes, routes);
+    merge_day_aggregate(checkpoint.aggregate.days, days);
+    return true;
+}
+
+/* Save checkpoint to filename, replacing it atomically. Returns false if the
+   checkpoint could not be written. */
+bool write_checkpoint(std::string const& filename, TailCheckpoint const& checkpoint)
+{
+    const std::string temporary_filename{ temporary_filename_for(filename) };
+    {
+        std::ofstream output{ temporary_filename, std::ios::binary | std::ios::trunc };
+        if (!output.is_open())
+            return false;
+
+        CheckpointHeader header{};
+        std::memcpy(header.magic, checkpoint_magic, sizeof(checkpoint_magic));
+        header.version = checkpoint_version;
+        header.byte_order = snapshot_byte_order;
+        header.offset = checkpoint.offset;
+        header.fingerprint = checkpoint.fingerprint;
+        header.valid_sailings = checkpoint.counts.valid_sailings;
+        header.total_lines = checkpoint.counts.total_lines;
+        header.route_count = checkpoint.aggregate.routes.routes.size();
+        header.day_count = checkpoint.aggregate.days.days.size();
+        output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        write_binary_column(output, checkpoint.aggregate.routes.routes);
+        write_binary_column(output, checkpoint.aggregate.days.days);
+        std::string counts{};
+        write_load_counts(counts, checkpoint.counts);
+        output.write(counts.data(), static_cast<std::streamsize>(counts.size()));
+
+        if (!output.good())
+        {
+            output.close();
+            std::filesystem::remove(temporary_filename);
+            return false;
+        }
+    }
+
+    return rename_into_place(temporary_filename, filename);
+}
+
+/* refresh_tail(input_filename, checkpoint, report)
+   Fold the complete lines appended to input_filename since the checkpoint
+   into it. Invalid lines are reported with their line numbers in the whole
+   file. Returns the number of new lines read. */
+int refresh_tail(std::string const& input_filename, TailCheckpoint& checkpoint, LoadReport const& report)
+{
+    const MappedFile input_file{ input_filename };
+    const std::string_view contents{ input_file.contents() };
+
+    if (checkpoint.offset > 0 && (contents.size() < checkpoint.offset || fingerprint_prefix(contents, checkpoint.offset) != checkpoint.fingerprint))
+    {
+        report.stream << "Input file was replaced; rereading it from the start." << std::endl;
+        checkpoint = TailCheckpoint{};
+    }
+
+    const std::string_view appended{ contents.substr(static_cast<size_t>(checkpoint.offset)) };
+    const size_t last_newline{ appended.rfind('\n') };
+    if (last_newline == std::string_view::npos)
+        return 0;
+
+    const LoadCounts added{ load_sailing_text(appended.substr(0, last_newline + 1), checkpoint.counts.total_lines + 1, checkpoint.aggregate, report) };
+    add_load_counts(checkpoint.counts, added, report.samples);
+    checkpoint.offset += last_newline + 1;
+    checkpoint.fingerprint = fingerprint_prefix(contents, checkpoint.offset);
+    return added.total_lines;
+}
+
+/* run_tail_mode(options)
+   Bring the aggregate for options.input_filename up to date, starting from
+   the checkpoint file if one is given, and print the report for the action
+   from it. With a follow interval this repeats forever, waking up every
+   options.follow_seconds seconds and printing a new report whenever lines
+   were appended. The checkpoint is saved after every refresh. */
+void run_tail_mode(DriverOptions const& options)
+{
+    const std::string& input_filename{ options.input_filename };
+    const std::string& checkpoint_filename{ options.checkpoint };
+    const int follow_seconds{ options.follow_seconds };
+
+    TailCheckpoint checkpoint{};
+    if (!checkpoint_filename.empty())
+        load_checkpoint(checkpoint_filename, checkpoint);
+
+    /* A follower must not stop at (and, after a restart, stop again at) an
+       appended line with a number too large for an int. */
+    LoadReport report{ load_report(options) };
+    report.keep_out_of_range = true;
+
+    bool first_refresh{ true };
+    while (true)
+    {
+        const int new_lines{ refresh_tail(input_filename, checkpoint, report) };
+        if (!checkpoint_filename.empty() && !write_checkpoint(checkpoint_filename, checkpoint))
+            std::cerr << "Unable to write checkpoint " << checkpoint_filename << std::endl;
+
+        if (first_refresh || new_lines > 0)
+        {
+            print_load_summary(checkpoint.counts, report);
+            run_action(options, checkpoint.aggregate, std::cout);
+        }
+        first_refresh = false;
+
+        if (follow_seconds <= 0)
+            break;
+        std::this_thread::sleep_for(std::chrono::seconds(follow_seconds));
+    }
+}
+
+/* Query server
+   serve loads its input once (a file, a directory or pattern, or an
+   archive) into a SailingTable and its SailingIndex, then answers queries
+   on a Unix domain socket, so repeated reports over the same data do not
+   parse it again. The protocol is line based. A client sends one request
+   per line: an action followed by report options in command-line syntax,
+   for example
+
+     days --route=30 --from=2024-06-01 --format=csv
+
+   and the server replies with the report followed by a line holding only
+   ".". The request "reload" reloads the input at once. The server also
+   compares the size and modification time of its input files with those
+   it loaded about once a second, and reloads them when they change; if a
+   reload fails, it keeps serving the data it has. Requests are answered one
+   at a time on a single thread, for any number of connected clients. Client
+   sockets are non-blocking: a reply the client has not read yet waits in
+   its output buffer, and that client's next request waits until the buffer
+   has drained, while the other clients are served. query is a small client
+   that sends one request and prints the reply. Both need a POSIX system. */
+
+/* The data a server answers from, and the files it was loaded from with
+   their stamps at the time. */
+struct ServedSailings
+{
+    SailingTable table{};
+    SailingIndex index{};
+    std::vector<std::string> files{};
+    std::vector<SourceStamp> stamps{};
+};
+
+/* The input files of options.input_filename and their current stamps.
+   Throws std::runtime_error if one of them cannot be read. */
+void stamp_served_files(DriverOptions const& options, std::vector<std::string>& files, std::vector<SourceStamp>& stamps)
+{
+    files = is_multi_file_input(options.input_filename) ? expand_input_files(options.input_filename)
+                                                        : std::vector<std::string>{ options.input_filename };
+    stamps.clear();
+    for (const std::string& file : files)
+        stamps.push_back(source_stamp(file));
+}
+
+/* load_served_sailings(options, served)
+   Load options.input_filename into served, reporting on the diagnostic
+   stream. The stamps are taken before the files are read, so a change made
+   during the load is picked up by the next check. served is only replaced
+   once the load has succeeded; otherwise the exception propagates. */
+void load_served_sailings(DriverOptions const& options, ServedSailings& served)
+{
+    ServedSailings loaded{};
+    stamp_served_files(options, loaded.files, loaded.stamps);
+    if (is_sailing_archive(options.input_filename))
+        loaded.table = read_sailing_archive(options.input_filename, SailingFilter{}, diagnostic_stream(options));
+    else if (is_multi_file_input(options.input_filename))
+        loaded.table = read_sailing_files(options.input_filename, options.loader, load_report(options));
+    else if (options.snapshot)
+        loaded.table = read_sailing_table_cached(options.input_filename, options.loader, load_report(options));
+    else
+        loaded.table = read_sailing_table(options.input_filename, options.loader, load_report(options));
+    loaded.index = make_sailing_index(loaded.table);
+    served = std::move(loaded);
+}
+
+/* True if the input files of served have been added, removed or changed
+   since they were loaded. A file that cannot be read right now (one that is
+   being replaced, say) does not count as a change. */
+bool served_files_changed(DriverOptions const& options, ServedSailings const& served)
+{
+    std::vector<std::string> files{};
+    std::vector<SourceStamp> stamps{};
+    try
+    {
+        stamp_served_files(options, files, stamps);
+    }
+    catch (std::runtime_error const&)
+    {
+        return false;
+    }
+    if (files != served.files)
+        return true;
+    for (size_t f{ 0 }; f < stamps.size(); f++)
+    {
+        if (stamps[f].size != served.stamps[f].size || stamps[f].mtime != served.stamps[f].mtime)
+            return true;
+    }
+    return false;
+}
+
+/* Reload served, keeping the old data if the load fails. Returns false in
+   that case, after writing the reason to the diagnostic stream. */
+bool reload_served_sailings(DriverOptions const& options, ServedSailings& served)
+{
+    try
+    {
+        load_served_sailings(options, served);
+        diagnostic_stream(options) << "Serving " << table_size(served.table) << " sailings." << std::endl;
+        return true;
+    }
+    catch (std::exception const& error)
+    {
+        diagnostic_stream(options) << "Reload failed: " << error.what() << std::endl;
+        /* Do not retry until the files change again. */
+        stamp_served_files(options, served.files, served.stamps);
+        return false;
+    }
+}
+
+/* True if option only shapes a report, and so may be given in a query.
+   Options that name files or change how the server loads or runs are not
+   accepted from clients. */
+bool is_query_option(std::string const& option)
+{
+    const char* const allowed[]{ "--route", "--from", "--to", "--min-delay", "--format", "--errors",
+                                 "--error-samples", "--group", "--top", "--min-sailings" };
+    const std::string name{ option.substr(0, option.find('=')) };
+    return std::any_of(std::begin(allowed), std::end(allowed), [&name](const char* allowed_name) { return name == allowed_name; });
+}
+
+/* answer_query(request, served)
+   The reply to one request line: the report, or the reason it could not
+   be produced, followed by the "." line. A request that fails (even for
+   lack of memory) only fails its own reply; the server keeps running. */
+std::string answer_query(std::string const& request, ServedSailings const& served)
+{
+    std::ostringstream reply{};
+    std::istringstream words{ request };
+    DriverOptions options{};
+    words >> options.action;
+    std::string option{};
+    while (words >> option)
+    {
+        if (!is_query_option(option))
+        {
+            reply << "Error: " << option << " cannot be used in a query.\n.\n";
+            return reply.str();
+        }
+        if (!parse_driver_option(option, options))
+        {
+            reply << "Invalid option " << option << "\n.\n";
+            return reply.str();
+        }
+    }
+
+    try
+    {
+        if (filter_is_set(options.filter))
+            run_action(options, select_sailings(served.table, filtered_rows(served.table, served.index, options.filter)), reply);
+        else
+            run_action(options, served.table, reply);
+    }
+    catch (std::exception const& error)
+    {
+        return std::string{ "Error: " } + error.what() + "\n.\n";
+    }
+    reply << ".\n";
+    return reply.str();
+}
+
+#ifndef _WIN32
+/* Write all of text to fd. Returns false if the peer has gone away. */
+bool write_all(int fd, std::string_view text)
+{
+    while (!text.empty())
+    {
+        const ssize_t written{ ::write(fd, text.data(), text.size()) };
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        text.remove_prefix(static_cast<size_t>(written));
+    }
+    return true;
+}
+
+/* Fill address for the socket at path. Returns false if path is too long
+   for a Unix domain socket address. */
+bool make_socket_address(std::string const& path, sockaddr_un& address)
+{
+    address = sockaddr_un{};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+        return false;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+/* Listen on a Unix domain socket at path, replacing a stale socket left
+   there by an earlier server. Returns the socket, or -1 on failure. */
+int open_query_socket(std::string const& path)
+{
+    sockaddr_un address{};
+    if (!make_socket_address(path, address))
+        return -1;
+    std::error_code error{};
+    if (std::filesystem::is_socket(path, error))
+        std::filesystem::remove(path, error);
+
+    const int fd{ ::socket(AF_UNIX, SOCK_STREAM, 0) };
+    if (fd < 0)
+        return -1;
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, 16) != 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* A connected client (its socket is non-blocking), the part of its input
+   that does not yet end in a newline, and the replies it has not read yet. */
+struct QueryClient
+{
+    int fd{ -1 };
+    std::string pending{};
+    std::string output{};
+};
+
+/* Read what client has sent. Returns false when the client has
+   disconnected (or misbehaved) and should be closed. */
+bool read_client_requests(QueryClient& client)
+{
+    char buffer[4096];
+    const ssize_t received{ ::read(client.fd, buffer, sizeof(buffer)) };
+    if (received < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+        return true;
+    if (received <= 0)
+        return false;
+    client.pending.append(buffer, static_cast<size_t>(received));
+    return true;
+}
+
+/* Write as much of client's unread replies as its socket takes without
+   blocking. Returns false if the client has gone away. */
+bool flush_client_output(QueryClient& client)
+{
+    size_t sent{ 0 };
+    while (sent < client.output.size())
+    {
+        const ssize_t written{ ::write(client.fd, client.output.data() + sent, client.output.size() - sent) };
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (written <= 0)
+            return false;
+        sent += static_cast<size_t>(written);
+    }
+    client.output.erase(0, sent);
+    return true;
+}
+
+/* Answer client's complete request lines in turn, stopping while a reply
+   is still waiting to be sent, so a client that does not read its replies
+   only holds up itself. Returns false if the client should be closed. */
+bool answer_client_requests(DriverOptions const& options, QueryClient& client, ServedSailings& served)
+{
+    const size_t max_request_bytes{ 1 << 16 };
+    size_t newline{ client.pending.find('\n') };
+    while (client.output.empty() && newline != std::string::npos)
+    {
+        std::string request{ client.pending.substr(0, newline) };
+        client.pending.erase(0, newline + 1);
+        if (!request.empty() && request.back() == '\r')
+            request.pop_back();
+
+        if (request == "reload")
+            client.output = (reload_served_sailings(options, served) ? "Reloaded " + std::to_string(table_size(served.table)) + " sailings.\n"
+                                                                     : std::string{ "Reload failed.\n" }) + ".\n";
+        else
+            client.output = answer_query(request, served);
+        if (!flush_client_output(client))
+            return false;
+        newline = client.pending.find('\n');
+    }
+    return newline != std::string::npos || client.pending.size() <= max_request_bytes;
+}
+
+/* run_query_server(options)
+   Load options.input_filename and answer queries on options.socket_path
+   until SIGINT or SIGTERM arrives (see "Query server" above), then close
+   the clients and remove the socket. The two signals are blocked and
+   checked for between polls, so a stop takes effect within a second.
+   Returns false if the socket could not be opened or polling failed. */
+bool run_query_server(DriverOptions const& options)
+{
+    const int reload_check_ms{ 1000 };
+
+    ServedSailings served{};
+    load_served_sailings(options, served);
+    const int listener{ open_query_socket(options.socket_path) };
+    if (listener < 0)
+    {
+        std::cout << "Unable to listen on " << options.socket_path << std::endl;
+        return false;
+    }
+    /* A client that disconnects before reading its reply must not end the
+       server. */
+    std::signal(SIGPIPE, SIG_IGN);
+    sigset_t stop_signals{};
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+    diagnostic_stream(options) << "Serving " << table_size(served.table) << " sailings on " << options.socket_path << "." << std::endl;
+
+    std::vector<QueryClient> clients{};
+    bool stopped{ false };
+    auto last_check{ std::chrono::steady_clock::now() };
+    while (true)
+    {
+        std::vector<pollfd> watched{ pollfd{ listener, POLLIN, 0 } };
+        for (const QueryClient& client : clients)
+            watched.push_back(pollfd{ client.fd, static_cast<short>(client.output.empty() ? POLLIN : POLLOUT), 0 });
+        if (::poll(watched.data(), watched.size(), reload_check_ms) < 0 && errno != EINTR)
+            break;
+        sigset_t pending{};
+        if (sigpending(&pending) == 0 && (sigismember(&pending, SIGINT) == 1 || sigismember(&pending, SIGTERM) == 1))
+        {
+            diagnostic_stream(options) << "Stopping." << std::endl;
+            stopped = true;
+            break;
+        }
+
+        const auto now{ std::chrono::steady_clock::now() };
+        if (now - last_check >= std::chrono::milliseconds(reload_check_ms))
+        {
+            last_check = now;
+            if (served_files_changed(options, served))
+                reload_served_sailings(options, served);
+        }
+
+        for (size_t c{ 0 }; c < clients.size(); c++)
+        {
+            const short events{ watched[c + 1].revents };
+            bool open{ true };
+            if ((events & (POLLERR | POLLNVAL)) != 0)
+                open = false;
+            else if ((events & POLLOUT) != 0)
+                open = flush_client_output(clients[c]) && answer_client_requests(options, clients[c], served);
+            else if ((events & (POLLIN | POLLHUP)) != 0)
+                open = read_client_requests(clients[c]) && answer_client_requests(options, clients[c], served);
+            if (!open)
+            {
+                ::close(clients[c].fd);
+                clients[c].fd = -1;
+            }
+        }
+        clients.erase(std::remove_if(clients.begin(), clients.end(), [](const QueryClient& client) { return client.fd < 0; }), clients.end());
+
+        if ((watched[0].revents & POLLIN) != 0)
+        {
+            const int fd{ ::accept(listener, nullptr, nullptr) };
+            if (fd >= 0 && ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK) == 0)
+                clients.push_back(QueryClient{ fd, "", "" });
+            else if (fd >= 0)
+                ::close(fd);
+        }
+    }
+    for (const QueryClient& client : clients)
+        ::close(client.fd);
+    ::close(listener);
+    std::error_code error{};
+    std::filesystem::remove(options.socket_path, error);
+    return stopped;
+}
+
+/* send_query(options)
+   Send options.request to the server listening on the socket
+   options.input_filename and print its reply without the closing "."
+   line. Returns false if the server could not be reached. */
+bool send_query(DriverOptions const& options)
+{
+    sockaddr_un address{};
+    const int fd{ ::socket(AF_UNIX, SOCK_STREAM, 0) };
+    if (fd < 0 || !make_socket_address(options.input_filename, address)
+        || ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+        || !write_all(fd, options.request + "\n"))
+    {
+        std::cout << "Unable to connect to " << options.input_filename << std::endl;
+        if (fd >= 0)
+            ::close(fd);
+        return false;
+    }
+
+    std::string reply{};
+    char buffer[1 << 16];
+    while (reply != ".\n" && (reply.size() < 3 || reply.compare(reply.size() - 3, 3, "\n.\n") != 0))
+    {
+        const ssize_t received{ ::read(fd, buffer, sizeof(buffer)) };
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            break;
+        reply.append(buffer, static_cast<size_t>(received));
+    }
+    ::close(fd);
+    const bool complete{ reply.size() >= 2 && reply.compare(reply.size() - 2, 2, ".\n") == 0 };
+    std::cout << (complete ? reply.substr(0, reply.size() - 2) : reply) << std::flush;
+    return complete;
+}
+#else
+bool run_query_server(DriverOptions const&)
+{
+    std::cout << "serve needs Unix domain sockets, which this build does not support." << std::endl;
+    return false;
+}
+
+bool send_query(DriverOptions const&)
+{
+    std::cout << "query needs Unix domain sockets, which this build does not support." << std::endl;
+    return false;
+}
+#endif
+
+/* Synthetic data and benchmarks
+   generate writes a sailing file of any size in the input format, modelled
+   on the routes, terminals, vessels and durations of the sample data, with
+   a chosen fraction of each kind of invalid line from the error datasets.
+   benchmark times loading, route aggregation and day aggregation of a file
+   separately, so a change to one of them can be measured on its own. */
+
+/* A route in the generated data: its two terminals, scheduled crossing
+   time, hours of service and the vessels that sail it. One-way routes only
+   have sailings from terminal_a, as in the sample data. */
+struct RouteProfile
+{
+    int route_number;
+    const char* terminal_a;
+    const char* terminal_b;
+    bool one_way;
+    int expected_duration;
+    int first_hour;
+    int last_hour;
+    const char* vessels[4];
+};
+
+const RouteProfile route_profiles[]{
+    { 1, "Tsawwassen", "Swartz Bay", false, 95, 7, 21, { "Spirit of British Columbia", "Spirit of Vancouver Island", "Coastal Celebration", "Queen of New Westminster" } },
+    { 2, "Horseshoe Bay", "Departure Bay", false, 100, 6, 21, { "Queen of Oak Bay", "Queen of Cowichan", "Queen of Alberni", "Queen of Coquitlam" } },
+    { 3, "Horseshoe Bay", "Langdale", false, 40, 6, 22, { "Queen of Surrey", "Queen of Coquitlam", "Queen of Alberni", "Queen of Surrey" } },
+    { 4, "Swartz Bay", "Fulford Harbour", true, 35, 6, 21, { "Skeena Queen", "Skeena Queen", "Skeena Queen", "Skeena Queen" } },
+    { 8, "Horseshoe Bay", "Bowen Island", true, 20, 5, 22, { "Queen of Capilano", "Queen of Capilano", "Queen of Capilano", "Queen of Capilano" } },
+    { 30, "Tsawwassen", "Duke Point", false, 120, 5, 20, { "Coastal Renaissance", "Coastal Inspiration", "Queen of Alberni", "Coastal Inspiration" } },
+};
+
+/* Write the fields of one line, corrupted as the given kind of invalid
+   line (or left alone if kind is -1). */
+void write_generated_line(ReportWriter& writer, std::array<std::string, sailing_field_count>& fields, int kind, std::mt19937_64& random)
+{
+    const size_t numeric_fields[]{ 0, 3, 4, 5, 6, 7, 9, 10 };
+    size_t field_count{ sailing_field_count };
+    switch (kind)
+    {
+    case 0:
+        field_count = 1 + random() % (sailing_field_count - 1);
+        break;
+    case 1:
+        fields[sailing_field_count - 1] += "," + std::to_string(random() % 200);
+        break;
+    case 2:
+        fields[random() % sailing_field_count] = random() % 2 == 0 ? "" : "  ";
+        break;
+    case 3:
+        fields[numeric_fields[random() % 8]] = random() % 2 == 0 ? "abcd" : "x" + std::to_string(random() % 100);
+        break;
+    case 4:
+        if (random() % 2 == 0)
+            fields[6] = std::to_string(24 + random() % 76);
+        else
+            fields[7] = std::to_string(60 + random() % 40);
+        break;
+    }
+    for (size_t i{ 0 }; i < field_count; i++)
+    {
+        if (i > 0)
+            writer.text(",");
+        writer.text(fields[i]);
+    }
+    writer.end_line();
+}
+
+/* generate_sailings(output_filename, settings)
+   Write settings.rows lines to output_filename. Every selected route sails
+   in each direction at each scheduled hour of the day, starting on
+   2017-01-01 and moving on a day at a time. A day has a random "weather"
+   level for each route that raises the chance of late sailings, so some
+   days and routes are clearly better or worse than others. The same
+   settings always produce the same file. */
+void generate_sailings(std::string const& output_filename, GeneratorSettings const& settings)
+{
+    std::vector<const RouteProfile*> routes{};
+    for (const RouteProfile& profile : route_profiles)
+    {
+        if (settings.routes.empty() || std::find(settings.routes.begin(), settings.routes.end(), profile.route_number) != settings.routes.end())
+            routes.push_back(&profile);
+    }
+    std::ofstream output_file{ output_filename, std::ios::binary };
+    if (!output_file.is_open())
+        throw std::runtime_error("Unable to open output file");
+
+    std::mt19937_64 random{ settings.seed };
+    std::uniform_real_distribution<double> uniform{ 0.0, 1.0 };
+    const int vessel_count{ std::max(1, std::min(settings.vessels, 4)) };
+    ReportWriter writer{ output_file };
+    std::array<std::string, sailing_field_count> fields{};
+    Date date{ 1, 1, 2017 };
+    long long written{ 0 };
+    while (written < settings.rows)
+    {
+        for (const RouteProfile* route : routes)
+        {
+            const double weather{ uniform(random) };
+            for (int hour{ route->first_hour }; hour <= route->last_hour && written < settings.rows; hour++)
+            {
+                for (int direction{ 0 }; direction < (route->one_way ? 1 : 2) && written < settings.rows; direction++)
+                {
+                    const bool late{ uniform(random) < 0.05 + 0.6 * weather * weather };
+                    const int delay{ late ? 5 + static_cast<int>(random() % 40) : static_cast<int>(random() % 10) - 5 };
+                    fields[0] = std::to_string(route->route_number);
+                    fields[1] = direction == 0 ? route->terminal_a : route->terminal_b;
+                    fields[2] = direction == 0 ? route->terminal_b : route->terminal_a;
+                    fields[3] = std::to_string(date.year);
+                    fields[4] = std::to_string(date.month);
+                    fields[5] = std::to_string(date.day);
+                    fields[6] = std::to_string(hour);
+                    fields[7] = std::to_string(direction == 0 ? 0 : 30);
+                    fields[8] = route->vessels[(hour + direction) % vessel_count];
+                    fields[9] = std::to_string(route->expected_duration);
+                    fields[10] = std::to_string(route->expected_duration + delay);
+
+                    int kind{ -1 };
+                    double draw{ uniform(random) };
+                    for (int k{ 0 }; k < malformed_line_kinds && kind < 0; k++)
+                    {
+                        if (draw < settings.malformed[k])
+                            kind = k;
+                        draw -= settings.malformed[k];
+                    }
+                    write_generated_line(writer, fields, kind, random);
+                    written++;
+                }
+            }
+        }
+        date = from_day_number(to_day_number(date) + 1);
+    }
+    writer.flush();
+    if (!output_file.good())
+        throw std::runtime_error("Unable to write output file");
+    std::cout << "Wrote " << written << " lines to " << output_filename << "." << std::endl;
+}
+
+/* Parse --routes=1,2,30 for generate. Only routes in route_profiles are
+   accepted. */
+bool parse_route_list(std::string const& list, std::vector<int>& routes)
+{
+    routes.clear();
+    size_t start{ 0 };
+    while (start <= list.size())
+    {
+        const size_t comma{ std::min(list.find(',', start), list.size()) };
+        int route{ 0 };
+        if (!parse_int_option(std::string_view{ list }.substr(start, comma - start), route)
+            || std::none_of(std::begin(route_profiles), std::end(route_profiles), [route](const RouteProfile& profile) { return profile.route_number == route; }))
+            return false;
+        routes.push_back(route);
+        start = comma + 1;
+    }
+    return true;
+}
+
+/* Parse --malformed=short:0.01,time:0.002 (a fraction of the lines for
+   each kind of invalid line). */
+bool parse_malformed_list(std::string const& list, double (&fractions)[malformed_line_kinds])
+{
+    std::fill(std::begin(fractions), std::end(fractions), 0.0);
+    size_t start{ 0 };
+    while (start <= list.size())
+    {
+        const size_t comma{ std::min(list.find(',', start), list.size()) };
+        const std::string entry{ list.substr(start, comma - start) };
+        const size_t colon{ entry.find(':') };
+        if (colon == std::string::npos)
+            return false;
+        const auto name{ std::find(std::begin(malformed_line_names), std::end(malformed_line_names), entry.substr(0, colon)) };
+        if (name == std::end(malformed_line_names))
+            return false;
+
+        const std::string fraction{ entry.substr(colon + 1) };
+        char* end{ nullptr };
+        const double value{ std::strtod(fraction.c_str(), &end) };
+        if (fraction.empty() || *end != '\0' || !(value >= 0.0 && value <= 1.0))
+            return false;
+        fractions[name - std::begin(malformed_line_names)] = value;
+        start = comma + 1;
+    }
+    return std::accumulate(std::begin(fractions), std::end(fractions), 0.0) <= 1.0;
+}
+
+/* Seconds taken by task, the best of repeat runs. */
+template <typename Task>
+double time_best_of(int repeat, Task task)
+{
+    double best{ 0 };
+    for (int run{ 0 }; run < repeat; run++)
+    {
+        const auto start{ std::chrono::steady_clock::now() };
+        task();
+        const std::chrono::duration<double> elapsed{ std::chrono::steady_clock::now() - start };
+        if (run == 0 || elapsed.count() < best)
+            best = elapsed.count();
+    }
+    return best;
+}
+
+void print_benchmark_line(std::string const& phase, double seconds, size_t records, std::uintmax_t bytes)
+{
+    std::cout << std::left << std::setw(18) << phase << std::right << std::fixed << std::setprecision(4) << seconds << " s";
+    std::cout << std::setw(14) << std::setprecision(0) << (seconds > 0 ? records / seconds : 0) << " records/s";
+    if (bytes > 0)
+        std::cout << std::setw(10) << std::setprecision(1) << (seconds > 0 ? bytes / seconds / (1 << 20) : 0) << " MB/s";
+    std::cout << std::defaultfloat << std::endl;
+}
+
+/* Time loading into sailings (a vector or a table) and the two
+   aggregations over the result. */
+template <typename Sailings>
+void benchmark_stages(DriverOptions const& options, std::uintmax_t bytes, Sailings& sailings)
+{
+    std::ostream discard{ nullptr };
+    const double load_seconds{ time_best_of(options.repeat, [&]() {
+        sailings = Sailings{};
+        load_sailings_into(options.input_filename, options.loader, sailings, LoadReport{ discard, options.error_summary, static_cast<size_t>(options.error_samples) });
+    }) };
+    const size_t records{ sailing_count(sailings) };
+    print_benchmark_line("load", load_seconds, records, bytes);
+
+    size_t routes{ 0 };
+    const double route_seconds{ time_best_of(options.repeat, [&]() { routes = performance_by_route(sailings).size(); }) };
+    print_benchmark_line("route aggregation", route_seconds, records, 0);
+
+    size_t days{ 0 };
+    size_t best{ 0 };
+    size_t worst{ 0 };
+    const double day_seconds{ time_best_of(options.repeat, [&]() {
+        const DayAggregate aggregate{ aggregate_days(sailings) };
+        days = aggregate.days.size();
+        best = best_days(aggregate).size();
+        worst = worst_days(aggregate).size();
+    }) };
+    print_benchmark_line("day aggregation", day_seconds, records, 0);
+    std::cout << records << " records, " << routes << " routes, " << days << " days (" << best << " best, " << worst << " worst)" << std::endl;
+}
+
+/* run_benchmark(options)
+   Time the three stages of a report on options.input_filename: loading
+   with the selected loader and storage, performance_by_route, and
+   aggregate_days with best_days and worst_days. Each stage runs
+   options.repeat times and the fastest run is reported, with throughput in
+   records and (for loading) megabytes of input per second. With
+   --storage=none loading and both aggregations happen in one pass, which
+   is timed as a whole. Invalid-line messages are discarded. */
+void run_benchmark(DriverOptions const& options)
+{
+    const std::uintmax_t bytes{ std::filesystem::file_size(options.input_filename) };
+    std::cout << "Benchmark of " << options.input_filename << " (" << bytes << " bytes, best of " << options.repeat << " runs)" << std::endl;
+    if (options.storage == "none")
+    {
+        size_t records{ 0 };
+        const double seconds{ time_best_of(options.repeat, [&]() {
+            std::ostream discard{ nullptr };
+            const StreamingAggregate aggregate{ aggregate_sailing_stream(options.input_filename, LoadReport{ discard, options.error_summary, static_cast<size_t>(options.error_samples) }) };
+            records = 0;
+            for (const RouteStatistics& route : aggregate.routes.routes)
+                records += route.total_sailings;
+        }) };
+        print_benchmark_line("streaming pass", seconds, records, bytes);
+    }
+    else if (options.storage == "columns")
+    {
+        SailingTable table{};
+        benchmark_stages(options, bytes, table);
+    }
+    else
+    {
+        std::vector<Sailing> sailings{};
+        benchmark_stages(options, bytes, sailings);
+    }
+}
+
+/* print_sailing(writer, sailing)
+   Write sailing to writer as one line in the text form. The caller passes
+   its writer, so printing many sailings fills one buffer instead of
+   building and flushing a writer for each. */
+void print_sailing(ReportWriter& writer, Sailing const& sailing)
+{
+    write_sailing(writer, ReportFormat::Text, SailingView{ sailing.route_number, sailing.source_terminal, sailing.dest_terminal, sailing.vessel_name,
+                                                           sailing.departure_date, sailing.scheduled_departure_time,
+                                                           sailing.expected_duration, sailing.actual_duration });
+}
+
+/* Write the report for options.action, computed from sailings (a
+   std::vector<Sailing>, a SailingTable or a StreamingAggregate), to output.
+   Returns false if the action is not recognized. */
+template <typename Sailings>
+bool run_action(DriverOptions const& options, Sailings const& sailings, std::ostream& output)
+{
+    const std::string& action{ options.action };
+    const ReportFormat format{ options.format };
+    ReportWriter writer{ output };
+    if (action == "route_summary")
+    {
+        write_heading(writer, format, "Performance by route:");
+        write_route_header(writer, format, false);
+        for (const RouteStatistics& stats : performance_by_route(sailings))
+            write_route(writer, format, "", stats);
+    }
+    else if (action == "days")
+    {
+        const DayAggregate aggregate{ aggregate_days(sailings) };
+        write_day_header(writer, format);
+        write_heading(writer, format, "Best days:");
+        for (const DayStatistics& stats : best_days(aggregate))
+            write_day(writer, format, "best", stats);
+        write_heading(writer, format, "Worst days:");
+        for (const DayStatistics& stats : worst_days(aggregate))
+            write_day(writer, format, "worst", stats);
+    }
+    else if (action == "daily")
+    {
+        write_day_header(writer, format);
+        write_heading(writer, format, "Sailings by day:");
+        for (const DayStatistics& stats : days_by_date(aggregate_days(sailings)))
+            write_day(writer, format, "day", stats);
+    }
+    else if (action == "top_days")
+    {
+        const DayAggregate aggregate{ aggregate_days(sailings) };
+        const size_t count{ static_cast<size_t>(options.top_count) };
+        write_day_header(writer, format);
+        write_heading(writer, format, "Best " + std::to_string(count) + " days:");
+        for (const DayStatistics& stats : best_days(aggregate, count, options.min_sailings))
+            write_day(writer, format, "best", stats);
+        write_heading(writer, format, "Worst " + std::to_string(count) + " days:");
+        for (const DayStatistics& stats : worst_days(aggregate, count, options.min_sailings))
+            write_day(writer, format, "worst", stats);
+    }
+    else if (action == "top_routes")
+    {
+        const auto statistics{ performance_by_route(sailings) };
+        const size_t count{ static_cast<size_t>(options.top_count) };
+        write_route_header(writer, format, true);
+        write_heading(writer, format, "Best " + std::to_string(count) + " routes:");
+        for (const RouteStatistics& stats : best_routes(statistics, count, options.min_sailings))
+            write_route(writer, format, "best", stats);
+        write_heading(writer, format, "Worst " + std::to_string(count) + " routes:");
+        for (const RouteStatistics& stats : worst_routes(statistics, count, options.min_sailings))
+            write_route(writer, format, "worst", stats);
+    }
+    else if (action == "group_by")
+    {
+        print_group_report(writer, format, options.group_by, sailings);
+    }
+    else if (action == "delays")
+    {
+        print_delay_report(writer, format, sailings);
+    }
+    else if (action == "trends")
+    {
+        print_trend_report(writer, format, sailings);
+    }
+    else if (action == "sailings")
+    {
+        write_sailings(writer, format, sailings);
+    }
+    else
+    {
+        writer.text("Invalid action ").text(action);
+        writer.end_line();
+        return false;
+    }
+    return true;
+}
+
+/* The stream for load summaries and invalid-line messages. Text reports
+   keep them on standard output, as before; CSV and JSON Lines reports send
+   them to standard error so that standard output holds only rows. */
+std::ostream& diagnostic_stream(DriverOptions const& options)
+{
+    return options.format == ReportFormat::Text ? std::cout : std::cerr;
+}
+
+/* Where loads report invalid lines: the diagnostic stream, one message per
+   line or a summary as selected by --errors. */
+LoadReport load_report(DriverOptions const& options)
+{
+    return LoadReport{ diagnostic_stream(options), options.error_summary, static_cast<size_t>(options.error_samples) };
+}
+
+void print_usage()
+{
+    std::cout << "Usage: ./assignment_2 action input_filename [options]" << std::endl;
+    std::cout << "       where action is 'route_summary', 'days', 'daily', 'top_days', 'top_routes', 'delays'," << std::endl;
+    std::cout << "       'trends', 'group_by' or 'sailings'" << std::endl;
+    std::cout << "       or    ./assignment_2 generate output_filename [--rows=N] [--routes=LIST] [--vessels=N]" << std::endl;
+    std::cout << "                                   [--seed=N] [--malformed=KIND:FRACTION,...]" << std::endl;
+    std::cout << "       or    ./assignment_2 benchmark input_filename [--loader=...] [--storage=...] [--repeat=N]" << std::endl;
+    std::cout << "       or    ./assignment_2 archive input_filename [--output=FILE] [--route=N] [--from=...] [--to=...]" << std::endl;
+    std::cout << "       or    ./assignment_2 shard input_filename --shard=K/N [--output=FILE]" << std::endl;
+    std::cout << "       or    ./assignment_2 serve input_filename --socket=PATH [--loader=...] [--snapshot]" << std::endl;
+    std::cout << "       or    ./assignment_2 query socket_path action [options]" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "       --loader=stream    read the file line by line (default)" << std::endl;
+    std::cout << "       --loader=mmap      memory-map the file and parse it in place" << std::endl;
+    std::cout << "       --loader=parallel  memory-map the file and parse it on all hardware threads" << std::endl;
+    std::cout << "       --loader=async     read large blocks ahead (io_uring where available) while parsing" << std::endl;
+    std::cout << "       --storage=rows     keep a vector of Sailing records (default)" << std::endl;
+    std::cout << "       --storage=columns  keep a column table with interned names" << std::endl;
+    std::cout << "       --storage=none     fold records into the report totals as they are read;" << std::endl;
+    std::cout << "                          input_filename may be '-' for standard input" << std::endl;
+    std::cout << "       --snapshot         reuse (or create) a binary snapshot beside the input file" << std::endl;
+    std::cout << "       --checkpoint=FILE  only read lines appended since the totals saved in FILE" << std::endl;
+    std::cout << "       --follow=SECONDS   keep running, rereading the appended lines every SECONDS" << std::endl;
+    std::cout << "       --route=N          report only on sailings of route N" << std::endl;
+    std::cout << "       --from=YYYY-MM-DD  report only on sailings on or after this date" << std::endl;
+    std::cout << "       --to=YYYY-MM-DD    report only on sailings on or before this date" << std::endl;
+    std::cout << "       --min-delay=N      report only on sailings at least N minutes over their expected duration" << std::endl;
+    std::cout << "       --errors=lines     print a message for every invalid line (default)" << std::endl;
+    std::cout << "       --errors=summary   count invalid lines by error and field, and print one summary" << std::endl;
+    std::cout << "       --error-samples=N  line numbers listed for each kind of error in the summary (default 5)" << std::endl;
+    std::cout << "       --format=text      print reports as text (default)" << std::endl;
+    std::cout << "       --format=csv       print reports as CSV with a header line" << std::endl;
+    std::cout << "       --format=jsonl     print reports as JSON Lines, one object per row" << std::endl;
+    std::cout << "       --top=K            number of days or routes listed by top_days and top_routes (default 10)" << std::endl;
+    std::cout << "       --min-sailings=N   top_days and top_routes skip entries with fewer than N sailings" << std::endl;
+    std::cout << "       --group=KEYS       group_by keys, a comma-separated list of route, source, dest," << std::endl;
+    std::cout << "                          vessel, year, month, hour, weekday, date and time (default route)" << std::endl;
+    std::cout << "       --memory=MB        memory budget of group_by with --storage=none (default 256)" << std::endl;
+    std::cout << "       --spill-dir=DIR    where group_by with --storage=none spills (default the temporary directory)" << std::endl;
+}
+
+/* True if action is one main knows: a report run_action writes, or one
+   of the actions that make files or talk to a server. */
+bool is_driver_action(std::string const& action)
+{
+    const char* const actions[]{ "route_summary", "days", "daily", "top_days", "top_routes", "group_by", "delays", "trends",
+                                 "sailings", "generate", "benchmark", "archive", "shard", "serve", "query" };
+    return std::any_of(std::begin(actions), std::end(actions), [&action](const char* name) { return action == name; });
+}
+
+/* Apply one command-line option to options. Returns false if the option
+   is not recognized or its value is invalid. */
+bool parse_driver_option(std::string const& option, DriverOptions& options)
+{
+    const size_t equals{ option.find('=') };
+    const std::string name{ option.substr(0, equals) };
+    const std::string value{ equals == std::string::npos ? "" : option.substr(equals + 1) };
+    std::vector<GroupDimension> groups{};
+    int number{ 0 };
+    long long rows{ 0 };
+    std::uint64_t seed{ 0 };
+    std::vector<int> routes{};
+    double fractions[malformed_line_kinds]{};
+    int count{ 0 };
+
+    if (option == "--loader=stream")
+    {
+        options.loader = LoaderKind::Stream;
+    }
+    else if (option == "--loader=mmap")
+    {
+        options.loader = LoaderKind::Mapped;
+    }
+    else if (option == "--loader=parallel")
+    {
+        options.loader = LoaderKind::Parallel;
+    }
+    else if (option == "--loader=async")
+    {
+        options.loader = LoaderKind::Async;
+    }
+    else if (name == "--storage" && (value == "rows" || value == "columns" || value == "none"))
+    {
+        options.storage = value;
+    }
+    else if (option == "--snapshot")
+    {
+        options.snapshot = true;
+    }
+    else if (name == "--group" && parse_group_dimensions(value, groups))
+    {
+        options.group_by = groups;
+    }
+    else if (name == "--route" && parse_int_option(value, options.filter.route))
+    {
+        options.filter.has_route = true;
+    }
+    else if (name == "--from" && parse_date_option(value, options.filter.first_date))
+    {
+        options.filter.has_first_date = true;
+    }
+    else if (name == "--to" && parse_date_option(value, options.filter.last_date))
+    {
+        options.filter.has_last_date = true;
+    }
+    else if (name == "--min-delay" && parse_int_option(value, options.filter.min_delay))
+    {
+        options.filter.has_min_delay = true;
+    }
+    else if (name == "--top" && parse_int_option(value, number) && number >= 0)
+    {
+        options.top_count = number;
+    }
+    else if (name == "--min-sailings" && parse_int_option(value, number))
+    {
+        options.min_sailings = number;
+    }
+    else if (option == "--format=text")
+    {
+        options.format = ReportFormat::Text;
+    }
+    else if (option == "--format=csv")
+    {
+        options.format = ReportFormat::Csv;
+    }
+    else if (option == "--format=jsonl")
+    {
+        options.format = ReportFormat::JsonLines;
+    }
+    else if (name == "--rows" && parse_int_option(value, rows) && rows >= 0)
+    {
+        options.generator.rows = rows;
+    }
+    else if (name == "--routes" && parse_route_list(value, routes))
+    {
+        options.generator.routes = routes;
+    }
+    else if (name == "--vessels" && parse_int_option(value, number) && number >= 1 && number <= 4)
+    {
+        options.generator.vessels = number;
+    }
+    else if (name == "--seed" && parse_int_option(value, seed))
+    {
+        options.generator.seed = seed;
+    }
+    else if (name == "--malformed" && parse_malformed_list(value, fractions))
+    {
+        std::copy(std::begin(fractions), std::end(fractions), std::begin(options.generator.malformed));
+    }
+    else if (name == "--repeat" && parse_int_option(value, number) && number >= 1)
+    {
+        options.repeat = number;
+    }
+    else if (option == "--errors=lines")
+    {
+        options.error_summary = false;
+    }
+    else if (option == "--errors=summary")
+    {
+        options.error_summary = true;
+    }
+    else if (name == "--error-samples" && parse_int_option(value, number) && number >= 0)
+    {
+        options.error_samples = number;
+    }
+    else if (name == "--memory" && parse_int_option(value, number) && number >= 1)
+    {
+        options.memory_mb = number;
+    }
+    else if (name == "--shard" && parse_shard_option(value, number, count))
+    {
+        options.shard_index = number;
+        options.shard_count = count;
+    }
+    else if (name == "--spill-dir" && !value.empty())
+    {
+        options.spill_directory = value;
+    }
+    else if (name == "--socket" && !value.empty())
+    {
+        options.socket_path = value;
+    }
+    else if (name == "--output" && !value.empty())
+    {
+        options.output = value;
+    }
+    else if (name == "--checkpoint" && !value.empty())
+    {
+        options.checkpoint = value;
+    }
+    else if (name == "--follow" && parse_int_option(value, number) && number >= 0)
+    {
+        options.follow_seconds = number;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+/* Fill options from argv. Prints a message and returns false if the
+   arguments are invalid. */
+bool parse_driver_options(int argc, char** argv, DriverOptions& options)
+{
+    if (argc < 3)
+    {
+        print_usage();
+        return false;
+    }
+
+    options.action = argv[1];
+    options.input_filename = argv[2];
+    if (!is_driver_action(options.action))
+    {
+        std::cout << "Invalid action " << options.action << std::endl;
+        print_usage();
+        return false;
+    }
+
+    /* The rest of a query's command line is the request itself. */
+    if (options.action == "query")
+    {
+        for (int i{ 3 }; i < argc; i++)
+            options.request += (i > 3 ? " " : "") + std::string{ argv[i] };
+        return true;
+    }
+
+    for (int i{ 3 }; i < argc; i++)
+    {
+        if (!parse_driver_option(argv[i], options))
+        {
+            std::cout << "Invalid option " << argv[i] << std::endl;
+            return false;
+        }
+    }
+
+    if (options.action != "generate" && is_multi_file_input(options.input_filename)
+        && (options.storage == "none" || options.snapshot || !options.checkpoint.empty() || options.follow_seconds > 0))
+    {
+        std::cout << "A directory or file pattern input cannot be used with --storage=none, --snapshot or --checkpoint." << std::endl;
+        return false;
+    }
+    if (options.snapshot && options.storage == "none")
+    {
+        std::cout << "--snapshot stores the parsed sailings; it cannot be used with --storage=none." << std::endl;
+        return false;
+    }
+    if (filter_is_set(options.filter) && (options.storage == "none" || !options.checkpoint.empty() || options.follow_seconds > 0))
+    {
+        std::cout << "--route, --from, --to and --min-delay need stored sailings; they cannot be used with --storage=none or --checkpoint." << std::endl;
+        return false;
+    }
+    if (options.action == "serve" && options.socket_path.empty())
+    {
+        std::cout << "serve needs --socket=PATH." << std::endl;
+        return false;
+    }
+    if (options.action == "serve" && (options.storage == "none" || !options.checkpoint.empty() || options.follow_seconds > 0))
+    {
+        std::cout << "serve keeps the sailings in memory; it cannot be used with --storage=none or --checkpoint." << std::endl;
+        return false;
+    }
+    if (options.action == "shard" && options.shard_count == 0)
+    {
+        std::cout << "shard needs --shard=K/N." << std::endl;
+        return false;
+    }
+    if (options.action == "shard" && options.output.empty() && is_multi_file_input(options.input_filename))
+    {
+        std::cout << "Sharding a directory or file pattern needs --output=FILE." << std::endl;
+        return false;
+    }
+    if (options.action == "shard" && filter_is_set(options.filter))
+    {
+        std::cout << "--route, --from, --to and --min-delay need stored sailings; they cannot be used with shard." << std::endl;
+        return false;
+    }
+    if (options.action == "archive" && options.output.empty() && is_multi_file_input(options.input_filename))
+    {
+        std::cout << "Archiving a directory or file pattern needs --output=FILE." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    DriverOptions options{};
+    if (!parse_driver_options(argc, argv, options))
+        return 1;
+
+    if (options.action == "generate")
+    {
+        generate_sailings(options.input_filename, options.generator);
+    }
+    else if (options.action == "benchmark")
+    {
+        run_benchmark(options);
+    }
+    else if (options.action == "archive")
+    {
+        if (!archive_sailings(options))
+            return 1;
+    }
+    else if (options.action == "shard")
+    {
+        if (!run_shard(options))
+            return 1;
+    }
+    else if (options.action == "serve")
+    {
+        if (!run_query_server(options))
+            return 1;
+    }
+    else if (options.action == "query")
+    {
+        if (!send_query(options))
+            return 1;
+    }
+    else if (!options.checkpoint.empty() || options.follow_seconds > 0)
+    {
+        run_tail_mode(options);
+    }
+    else if (is_sailing_archive(options.input_filename))
+    {
+        const SailingTable table{ read_sailing_archive(options.input_filename, options.filter, diagnostic_stream(options)) };
+        if (options.storage == "columns")
+            run_action(options, table, std::cout);
+        else
+            run_action(options, table_to_sailings(table), std::cout);
+    }
+    else if (is_partial_aggregate_input(options.input_filename))
+    {
+        if (filter_is_set(options.filter))
+        {
+            std::cout << "--route, --from, --to and --min-delay need stored sailings; they cannot be used with partial aggregates." << std::endl;
+            return 1;
+        }
+        ShardAggregate merged{};
+        if (!merge_partial_aggregates(options, merged))
+            return 1;
+        run_action(options, merged, std::cout);
+    }
+    else if (options.storage == "none" && options.action == "group_by")
+    {
+        run_external_group_by(options);
+    }
+    else if (options.storage == "none")
+    {
+        const StreamingAggregate aggregate{ aggregate_sailing_stream(options.input_filename, load_report(options)) };
+        run_action(options, aggregate, std::cout);
+    }
+    else if (is_multi_file_input(options.input_filename))
+    {
+        const SailingTable table{ read_sailing_files(options.input_filename, options.loader, load_report(options)) };
+        if (options.storage == "columns")
+            run_filtered_action(options, table);
+        else
+            run_filtered_action(options, table_to_sailings(table));
+    }
+    else if (options.snapshot)
+    {
+        const SailingTable table{ read_sailing_table_cached(options.input_filename, options.loader, load_report(options)) };
+        if (options.storage == "columns")
+            run_filtered_action(options, table);
+        else
+            run_filtered_action(options, table_to_sailings(table));
+    }
+    else if (options.storage == "columns")
+    {
+        const SailingTable table{ read_sailing_table(options.input_filename, options.loader, load_report(options)) };
+        run_filtered_action(options, table);
+    }
+    else
+    {
+        std::vector<Sailing> all_sailings{};
+        load_sailings_into(options.input_filename, options.loader, all_sailings, load_report(options));
+        run_filtered_action(options, all_sailings);
+    }
+
+    return 0;
+}